@@ -0,0 +1,489 @@
+/*
+ * logvisor_bench: latency and throughput benchmarks for the reporting path
+ *
+ * Usage: logvisor_bench [options]
+ *   --out <file>          Write results as JSON (default: logvisor_bench.json)
+ *   --baseline <file>     Compare against a previous --out file; exits with 1 on regression
+ *   --threshold <pct>     Relative change counted as a regression (default: 10)
+ *   --min-delta-ns <ns>   Ignore latency changes smaller than this (default: 5)
+ *   --iterations <n>      Timed calls per latency case (default: 200000)
+ *   --records <n>         Records per contention and sink case (default: 400000)
+ *   --max-threads <n>     Largest producer count for contention scaling (default: 64)
+ *   --dir <dir>           Directory for file sinks (default: /dev/shm if present, else the temp dir)
+ *   --filter <text>       Only run cases whose name contains text
+ *
+ * Cases:
+ *   report/<n>-sinks        Module::report latency with 0, 1 and 3 file sinks
+ *   reportSource/<n>-sinks  Module::reportSource latency
+ *   reportSite/<n>-sinks    LOGVISOR_REPORT latency
+ *   contention/<n>-threads  Aggregate throughput of n producers sharing one FileLogger
+ *   sink/<name>             Single-thread throughput of one sink
+ *
+ * Metrics ending in _ns are lower-is-better, metrics ending in _per_sec higher-is-better.
+ * The console sink writes stderr to the null device and runs last, since RegisterConsoleLogger
+ * only takes effect once per process.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "logvisor/logvisor.hpp"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+logvisor::Module Log("logvisor::bench");
+
+struct Result {
+  std::string name;
+  std::vector<std::pair<std::string, double>> metrics;
+};
+
+struct Options {
+  const char* outPath = "logvisor_bench.json";
+  const char* baselinePath = nullptr;
+  double threshold = 10.0;
+  double minDeltaNs = 5.0;
+  size_t iterations = 200000;
+  size_t records = 400000;
+  unsigned maxThreads = 64;
+  std::filesystem::path dir;
+  const char* filter = nullptr;
+};
+
+class Bench {
+  const Options& m_options;
+  std::vector<Result> m_results;
+  double m_timerOverhead = 0.0;
+  /* File loggers keep the path pointer they were registered with */
+  std::deque<std::string> m_paths;
+
+  const char* filePath(const char* name) {
+    m_paths.push_back((m_options.dir / ("logvisor_bench_" + std::to_string(m_paths.size()) + "_" + name)).string());
+    return m_paths.back().c_str();
+  }
+
+  void registerFileSinks(unsigned count) {
+    if (count >= 1)
+      logvisor::RegisterFileLogger(filePath("file.log"));
+    if (count >= 2)
+      logvisor::RegisterBinaryFileLogger(filePath("binary.bin"));
+    if (count >= 3)
+      logvisor::RegisterBufferedFileLogger(filePath("buffered.log"));
+  }
+
+  void resetSinks() {
+    logvisor::UnregisterLoggers();
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(m_options.dir, ec)) {
+      if (entry.path().filename().string().rfind("logvisor_bench_", 0) == 0)
+        std::filesystem::remove(entry.path(), ec);
+    }
+  }
+
+  uint64_t filesSize() const {
+    uint64_t size = 0;
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(m_options.dir, ec)) {
+      if (entry.path().filename().string().rfind("logvisor_bench_", 0) == 0)
+        size += entry.file_size(ec);
+    }
+    return size;
+  }
+
+  bool selected(const std::string& name) const {
+    return !m_options.filter || name.find(m_options.filter) != std::string::npos;
+  }
+
+  void add(Result result) {
+    std::printf("%-28s", result.name.c_str());
+    for (const auto& [key, value] : result.metrics)
+      std::printf(" %s=%.6g", key.c_str(), value);
+    std::printf("\n");
+    std::fflush(stdout);
+    m_results.push_back(std::move(result));
+  }
+
+  /* Median cost of the two clock reads that bracket every timed call */
+  void calibrate() {
+    std::vector<int64_t> samples(100000);
+    for (auto& sample : samples) {
+      const auto start = Clock::now();
+      const auto end = Clock::now();
+      sample = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    }
+    std::sort(samples.begin(), samples.end());
+    m_timerOverhead = double(samples[samples.size() / 2]);
+  }
+
+  static double Percentile(const std::vector<double>& sorted, double fraction) {
+    const size_t index = std::min(sorted.size() - 1, size_t(fraction * double(sorted.size())));
+    return sorted[index];
+  }
+
+  void latency(const std::string& name, unsigned sinks, const std::function<void(size_t)>& call) {
+    if (!selected(name))
+      return;
+    registerFileSinks(sinks);
+    const size_t iterations = m_options.iterations;
+    for (size_t i = 0; i < iterations / 10; ++i)
+      call(i);
+
+    std::vector<double> samples(iterations);
+    for (size_t i = 0; i < iterations; ++i) {
+      const auto start = Clock::now();
+      call(i);
+      const auto end = Clock::now();
+      samples[i] = std::max(0.0, double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()) -
+                                     m_timerOverhead);
+    }
+    logvisor::FlushLog();
+    resetSinks();
+
+    double sum = 0.0;
+    for (double sample : samples)
+      sum += sample;
+    std::sort(samples.begin(), samples.end());
+    add({name,
+         {{"mean_ns", sum / double(iterations)},
+          {"p50_ns", Percentile(samples, 0.5)},
+          {"p99_ns", Percentile(samples, 0.99)},
+          {"p999_ns", Percentile(samples, 0.999)}}});
+  }
+
+  void contention(unsigned threadCount) {
+    const std::string name = "contention/" + std::to_string(threadCount) + "-threads";
+    if (!selected(name))
+      return;
+    registerFileSinks(1);
+    const size_t perThread = std::max<size_t>(1, m_options.records / threadCount);
+    std::atomic_uint ready{0};
+    std::atomic_bool go{false};
+    std::vector<std::vector<double>> samples(threadCount);
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount);
+    for (unsigned t = 0; t < threadCount; ++t) {
+      threads.emplace_back([&, t]() {
+        auto& threadSamples = samples[t];
+        threadSamples.reserve(perThread);
+        ready.fetch_add(1);
+        while (!go.load(std::memory_order_acquire))
+          std::this_thread::yield();
+        for (size_t i = 0; i < perThread; ++i) {
+          const auto start = Clock::now();
+          Log.report(logvisor::Info, FMT_STRING("contention {} {}"), t, i);
+          const auto end = Clock::now();
+          threadSamples.push_back(double(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()));
+        }
+      });
+    }
+    while (ready.load() != threadCount)
+      std::this_thread::yield();
+    const auto start = Clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& thread : threads)
+      thread.join();
+    logvisor::FlushLog();
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    resetSinks();
+
+    std::vector<double> all;
+    all.reserve(perThread * threadCount);
+    for (const auto& threadSamples : samples)
+      all.insert(all.end(), threadSamples.begin(), threadSamples.end());
+    std::sort(all.begin(), all.end());
+    add({name,
+         {{"records_per_sec", double(all.size()) / seconds},
+          {"p50_ns", Percentile(all, 0.5)},
+          {"p99_ns", Percentile(all, 0.99)}}});
+  }
+
+  void throughput(const std::string& name, const std::function<void()>& registerSink) {
+    if (!selected(name))
+      return;
+    registerSink();
+    const size_t records = m_options.records;
+    const auto start = Clock::now();
+    for (size_t i = 0; i < records; ++i)
+      Log.report(logvisor::Info, FMT_STRING("throughput record {} of {}: {:.3f}"), i, records, double(i) * 0.5);
+    logvisor::FlushLog();
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    const uint64_t bytes = filesSize();
+    resetSinks();
+
+    Result result{name, {{"records_per_sec", double(records) / seconds}}};
+    if (bytes)
+      result.metrics.emplace_back("bytes_per_sec", double(bytes) / seconds);
+    add(std::move(result));
+  }
+
+public:
+  explicit Bench(const Options& options) : m_options(options) {}
+
+  void run() {
+    calibrate();
+    std::printf("timer overhead %.0f ns, file sinks in %s\n", m_timerOverhead, m_options.dir.string().c_str());
+
+    for (unsigned sinks : {0u, 1u, 3u}) {
+      const std::string suffix = "/" + std::to_string(sinks) + "-sinks";
+      latency("report" + suffix, sinks,
+              [](size_t i) { Log.report(logvisor::Info, FMT_STRING("latency {} {}"), i, double(i) * 0.25); });
+      latency("reportSource" + suffix, sinks, [](size_t i) {
+        Log.reportSource(logvisor::Info, __FILE__, __LINE__, FMT_STRING("latency {} {}"), i, double(i) * 0.25);
+      });
+      latency("reportSite" + suffix, sinks,
+              [](size_t i) { LOGVISOR_REPORT(Log, logvisor::Info, "latency {} {}", i, double(i) * 0.25); });
+    }
+
+    for (unsigned threads = 1; threads <= m_options.maxThreads; threads *= 2)
+      contention(threads);
+
+    throughput("sink/file", [this]() { logvisor::RegisterFileLogger(filePath("file.log")); });
+    throughput("sink/buffered-file",
+               [this]() { logvisor::RegisterBufferedFileLogger(filePath("buffered.log")); });
+    throughput("sink/binary-file", [this]() { logvisor::RegisterBinaryFileLogger(filePath("binary.bin")); });
+    throughput("sink/console", []() {
+#if _WIN32
+      std::freopen("NUL", "w", stderr);
+#else
+      std::freopen("/dev/null", "w", stderr);
+#endif
+      logvisor::RegisterConsoleLogger();
+    });
+  }
+
+  const std::vector<Result>& results() const { return m_results; }
+};
+
+void WriteJson(FILE* out, const std::vector<Result>& results) {
+  std::fputs("{\n  \"benchmarks\": [\n", out);
+  for (size_t i = 0; i < results.size(); ++i) {
+    std::fprintf(out, "    {\"name\": \"%s\"", results[i].name.c_str());
+    for (const auto& [key, value] : results[i].metrics)
+      std::fprintf(out, ", \"%s\": %.6g", key.c_str(), value);
+    std::fputs(i + 1 < results.size() ? "},\n" : "}\n", out);
+  }
+  std::fputs("  ]\n}\n", out);
+}
+
+/*
+ * Reads the benchmarks array written by WriteJson. Only strings and numbers are expected inside
+ * the benchmark objects; anything else ends parsing.
+ */
+class BaselineParser {
+  std::string_view m_text;
+  size_t m_pos = 0;
+
+  void skipSpace() {
+    while (m_pos < m_text.size() && std::strchr(" \t\r\n", m_text[m_pos]))
+      ++m_pos;
+  }
+
+  bool consume(char ch) {
+    skipSpace();
+    if (m_pos < m_text.size() && m_text[m_pos] == ch) {
+      ++m_pos;
+      return true;
+    }
+    return false;
+  }
+
+  bool string(std::string& out) {
+    if (!consume('"'))
+      return false;
+    out.clear();
+    while (m_pos < m_text.size() && m_text[m_pos] != '"') {
+      if (m_text[m_pos] == '\\' && m_pos + 1 < m_text.size())
+        ++m_pos;
+      out += m_text[m_pos++];
+    }
+    return consume('"');
+  }
+
+  bool number(double& out) {
+    skipSpace();
+    const std::string rest(m_text.substr(m_pos, 64));
+    char* end;
+    out = std::strtod(rest.c_str(), &end);
+    if (end == rest.c_str())
+      return false;
+    m_pos += size_t(end - rest.c_str());
+    return true;
+  }
+
+public:
+  explicit BaselineParser(std::string_view text) : m_text(text) {}
+
+  bool parse(std::map<std::string, std::map<std::string, double>>& out) {
+    const size_t key = m_text.find("\"benchmarks\"");
+    if (key == std::string_view::npos)
+      return false;
+    m_pos = key + std::strlen("\"benchmarks\"");
+    if (!consume(':') || !consume('['))
+      return false;
+    if (consume(']'))
+      return true;
+    do {
+      if (!consume('{'))
+        return false;
+      std::string name;
+      std::map<std::string, double> metrics;
+      do {
+        std::string field;
+        if (!string(field) || !consume(':'))
+          return false;
+        skipSpace();
+        if (m_pos < m_text.size() && m_text[m_pos] == '"') {
+          std::string value;
+          if (!string(value))
+            return false;
+          if (field == "name")
+            name = std::move(value);
+        } else {
+          double value;
+          if (!number(value))
+            return false;
+          metrics[field] = value;
+        }
+      } while (consume(','));
+      if (!consume('}'))
+        return false;
+      out[name] = std::move(metrics);
+    } while (consume(','));
+    return consume(']');
+  }
+};
+
+bool EndsWith(std::string_view str, std::string_view suffix) {
+  return str.size() >= suffix.size() && str.substr(str.size() - suffix.size()) == suffix;
+}
+
+/* Returns the number of regressions, or -1 if the baseline could not be read */
+int Compare(const Options& options, const std::vector<Result>& results) {
+  FILE* fp = std::fopen(options.baselinePath, "rb");
+  if (!fp) {
+    std::fprintf(stdout, "logvisor_bench: unable to open %s\n", options.baselinePath);
+    return -1;
+  }
+  std::string text;
+  char chunk[4096];
+  size_t read;
+  while ((read = std::fread(chunk, 1, sizeof(chunk), fp)))
+    text.append(chunk, read);
+  std::fclose(fp);
+
+  std::map<std::string, std::map<std::string, double>> baseline;
+  if (!BaselineParser(text).parse(baseline)) {
+    std::fprintf(stdout, "logvisor_bench: %s is not a logvisor_bench result file\n", options.baselinePath);
+    return -1;
+  }
+
+  std::printf("\ncomparison against %s (threshold %.1f%%)\n", options.baselinePath, options.threshold);
+  int regressions = 0;
+  for (const auto& result : results) {
+    auto bench = baseline.find(result.name);
+    if (bench == baseline.end())
+      continue;
+    for (const auto& [key, value] : result.metrics) {
+      auto base = bench->second.find(key);
+      if (base == bench->second.end() || base->second <= 0.0)
+        continue;
+      const double change = (value - base->second) / base->second * 100.0;
+      bool regressed = false;
+      if (EndsWith(key, "_ns"))
+        regressed = change > options.threshold && value - base->second >= options.minDeltaNs;
+      else if (EndsWith(key, "_per_sec"))
+        regressed = -change > options.threshold;
+      if (regressed)
+        ++regressions;
+      std::printf("%s %-28s %-16s %12.6g -> %12.6g (%+.1f%%)\n", regressed ? "REGRESSED" : "         ",
+                  result.name.c_str(), key.c_str(), base->second, value, change);
+    }
+  }
+  std::printf("%d regression%s\n", regressions, regressions == 1 ? "" : "s");
+  return regressions;
+}
+
+std::filesystem::path DefaultDir() {
+  std::error_code ec;
+  if (std::filesystem::is_directory("/dev/shm", ec))
+    return "/dev/shm";
+  return std::filesystem::temp_directory_path(ec);
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+  Options options;
+  bool badArgs = false;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+    if (!value) {
+      badArgs = true;
+      break;
+    }
+    ++i;
+    if (arg == "--out")
+      options.outPath = value;
+    else if (arg == "--baseline")
+      options.baselinePath = value;
+    else if (arg == "--threshold")
+      options.threshold = std::strtod(value, nullptr);
+    else if (arg == "--min-delta-ns")
+      options.minDeltaNs = std::strtod(value, nullptr);
+    else if (arg == "--iterations")
+      options.iterations = std::max<size_t>(1, std::strtoull(value, nullptr, 10));
+    else if (arg == "--records")
+      options.records = std::max<size_t>(1, std::strtoull(value, nullptr, 10));
+    else if (arg == "--max-threads")
+      options.maxThreads = std::max(1u, unsigned(std::strtoul(value, nullptr, 10)));
+    else if (arg == "--dir")
+      options.dir = value;
+    else if (arg == "--filter")
+      options.filter = value;
+    else
+      badArgs = true;
+  }
+  if (badArgs) {
+    std::fputs("Usage: logvisor_bench [--out <file>] [--baseline <file>] [--threshold <pct>] [--min-delta-ns <ns>]\n"
+               "                      [--iterations <n>] [--records <n>] [--max-threads <n>] [--dir <dir>]\n"
+               "                      [--filter <text>]\n",
+               stderr);
+    return 2;
+  }
+  if (options.dir.empty())
+    options.dir = DefaultDir();
+
+  Bench bench(options);
+  bench.run();
+
+  FILE* out = std::fopen(options.outPath, "w");
+  if (!out) {
+    std::fprintf(stdout, "logvisor_bench: unable to open %s\n", options.outPath);
+    return 1;
+  }
+  WriteJson(out, bench.results());
+  std::fclose(out);
+
+  if (options.baselinePath) {
+    const int regressions = Compare(options, bench.results());
+    if (regressions != 0)
+      return 1;
+  }
+  return 0;
+}
@@ -4,9 +4,18 @@
 #include <cstdio>
 #include <cstdlib>
 #include <vector>
+#include <array>
 #include <atomic>
+#include <chrono>
 #include <memory>
 #include <mutex>
+#include <new>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 
 #include <fmt/format.h>
 
@@ -17,6 +26,13 @@
 extern "C" void logvisorBp();
 #define log_typeid(type) std::hash<std::string>()(#type)
 
+/* Report wrappers are inlined even in unoptimized builds so they never show up in captured stacks */
+#if _MSC_VER
+#define LOGVISOR_ALWAYS_INLINE __forceinline
+#else
+#define LOGVISOR_ALWAYS_INLINE inline __attribute__((always_inline))
+#endif
+
 namespace logvisor {
 
 [[noreturn]] void logvisorAbort();
@@ -34,12 +50,157 @@ enum Level {
   Fatal    /**< Non-recoverable error message (throws exception) */
 };
 
+class Module;
+class Sampler;
+
+/**
+ * @brief Static description of a logging call site
+ *
+ * Emitted as a constant by LOGVISOR_REPORT. Its address is stable for the lifetime of the
+ * program, so loggers may use it as an ID for the call site.
+ */
+struct CallSite {
+  const Module* module;
+  Level severity;
+  const char* file;
+  unsigned linenum;
+  fmt::string_view format;
+  const Sampler* sampler = nullptr; /**< Declared by LOGVISOR_REPORT_SAMPLED, nullptr otherwise */
+};
+
+/**
+ * @brief Named, typed value attached to a structured report
+ *
+ * Built with kv(). Keys and string values are referenced, not copied, so a Field is only valid
+ * for the duration of the report call; the async writer copies them into its queue.
+ */
+struct Field {
+  enum class Type : uint8_t { Int, UInt, Float, Bool, String };
+
+  std::string_view key;
+  Type type = Type::Int;
+  union {
+    int64_t i;
+    uint64_t u;
+    double f;
+    bool b;
+    struct {
+      const char* data;
+      size_t size;
+    } str;
+  } value{};
+
+  std::string_view string() const { return {value.str.data, value.str.size}; }
+};
+
+/**
+ * @brief Make a structured field from an arithmetic, enum or string value
+ */
+template <typename T>
+constexpr Field kv(std::string_view key, const T& value) {
+  Field field;
+  field.key = key;
+  if constexpr (std::is_same_v<T, bool>) {
+    field.type = Field::Type::Bool;
+    field.value.b = value;
+  } else if constexpr (std::is_enum_v<T>) {
+    field.type = Field::Type::Int;
+    field.value.i = int64_t(value);
+  } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+    field.type = Field::Type::Int;
+    field.value.i = value;
+  } else if constexpr (std::is_integral_v<T>) {
+    field.type = Field::Type::UInt;
+    field.value.u = value;
+  } else if constexpr (std::is_floating_point_v<T>) {
+    field.type = Field::Type::Float;
+    field.value.f = double(value);
+  } else {
+    static_assert(std::is_convertible_v<const T&, std::string_view>, "kv() needs an arithmetic, enum or string value");
+    const std::string_view str(value);
+    field.type = Field::Type::String;
+    field.value.str = {str.data(), str.size()};
+  }
+  return field;
+}
+
+namespace detail {
+
+/* Appends " key=value" for each field, quoting strings that would not survive a split on spaces */
+void AppendFields(fmt::memory_buffer& out, const Field* fields, size_t count);
+
+template <typename... Args>
+inline constexpr bool HasFields = (std::is_same_v<std::decay_t<Args>, Field> || ...);
+
+} // namespace detail
+
+/**
+ * @brief Single log event as captured at the reporting call
+ *
+ * Timestamp, frame index and thread name are taken on the reporting thread, so they
+ * remain accurate when the record is delivered later by the asynchronous writer.
+ */
+struct LogRecord {
+  const char* modName;
+  Level severity;
+  const char* file;  /**< Source file for reportSource events, nullptr otherwise */
+  unsigned linenum;
+  fmt::string_view format;
+  fmt::format_args args;
+  std::chrono::steady_clock::duration uptime; /**< Time since logvisor initialization */
+  uint64_t frameIndex;
+  const char* threadName; /**< Name given by RegisterThreadName, nullptr if unnamed */
+  const CallSite* site;   /**< Originating LOGVISOR_REPORT call site, nullptr otherwise */
+  mutable fmt::string_view renderedMessage; /**< Cache for message(), empty until first rendered */
+  fmt::memory_buffer* messageBuffer;        /**< Storage message() renders into */
+  uint32_t stackId = 0;    /**< Backtrace in the stack table (see EnableStackCapture), 0 if none */
+  float sampleRate = 1.0f; /**< Fraction of the call site's events that were reported (see Sampler) */
+  const Field* fields = nullptr; /**< Typed fields of a structured report, not part of message() */
+  size_t fieldCount = 0;
+
+  /**
+   * @brief Message body formatted from format and args
+   *
+   * Rendered on first use and shared by every logger receiving this record.
+   */
+  fmt::string_view message() const {
+    if (!renderedMessage.data()) {
+      messageBuffer->clear();
+      fmt::vformat_to(std::back_inserter(*messageBuffer), format, args);
+      renderedMessage = fmt::string_view(messageBuffer->data(), messageBuffer->size());
+    }
+    return renderedMessage;
+  }
+};
+
+struct ILogger;
+
+namespace detail {
+
+/* Per-logger statistics, defined in logvisor.cpp */
+struct SinkCounters;
+std::shared_ptr<SinkCounters> NewSinkCounters();
+SinkCounters& GetSinkCounters(ILogger& logger);
+
+} // namespace detail
+
 /**
  * @brief Backend interface for receiving app-wide log events
  */
 struct ILogger {
 private:
   uint64_t m_typeHash;
+  std::shared_ptr<detail::SinkCounters> m_sinkCounters = detail::NewSinkCounters();
+  friend detail::SinkCounters& detail::GetSinkCounters(ILogger& logger);
+
+protected:
+  /**
+   * @brief Account output produced for a record, reported as SinkStats::bytes
+   *
+   * Called from reportRecord, while the log lock is held.
+   */
+  void countBytes(size_t bytes);
+
 public:
   ILogger(uint64_t typeHash) : m_typeHash(typeHash) {}
   virtual ~ILogger() = default;
@@ -47,7 +208,47 @@ public:
   virtual void reportSource(const char* modName, Level severity, const char* file, unsigned linenum,
                             fmt::string_view format, fmt::format_args args) = 0;
 
+  /**
+   * @brief Entry point used by the log dispatcher
+   *
+   * Loggers that need the captured timestamp, thread name or typed fields should override this;
+   * the default forwards to report or reportSource, with fields rendered into the message.
+   */
+  virtual void reportRecord(const LogRecord& rec) {
+    if (rec.fieldCount) {
+      fmt::memory_buffer text;
+      const fmt::string_view message = rec.message();
+      text.append(message.data(), message.data() + message.size());
+      detail::AppendFields(text, rec.fields, rec.fieldCount);
+      const fmt::string_view view(text.data(), text.size());
+      const auto args = fmt::make_format_args(view);
+      if (rec.file)
+        reportSource(rec.modName, rec.severity, rec.file, rec.linenum, "{}", args);
+      else
+        report(rec.modName, rec.severity, "{}", args);
+      return;
+    }
+    if (rec.file)
+      reportSource(rec.modName, rec.severity, rec.file, rec.linenum, rec.format, rec.args);
+    else
+      report(rec.modName, rec.severity, rec.format, rec.args);
+  }
+
+  /**
+   * @brief Write the Fatal line assembled by a crash handler, just before the process exits
+   *
+   * Called from the signal handlers installed by RegisterStandardExceptions, without the log lock.
+   * Implementations may only use async-signal-safe calls, such as write(2) on a descriptor opened
+   * earlier, and should first write out anything they are still buffering. The default does nothing.
+   */
+  virtual void reportSignalSafe(const char* /*line*/, size_t /*size*/) {}
+
   [[nodiscard]] uint64_t  getTypeId() const { return m_typeHash; }
+
+  /**
+   * @brief Short name identifying the kind of logger in SinkStats
+   */
+  virtual const char* sinkName() const { return "custom"; }
 };
 
 /**
@@ -63,13 +264,30 @@ void KillProcessTree();
  */
 void RegisterThreadName(const char* name);
 
+/**
+ * @brief Snapshot of every thread that has called RegisterThreadName
+ * @return Thread ID and most recently registered name, newest thread first
+ *
+ * Entries outlive their threads. Does not take the log lock, so it is safe to call from loggers.
+ */
+std::vector<std::pair<std::thread::id, const char*>> GetThreadNames();
+
 /**
  * @brief Centralized logger vector
  *
- * All loggers added to this vector will receive reports as they occur
+ * All loggers added to this vector will receive reports as they occur.
+ * Add custom loggers with RegisterLogger; reporting threads only see loggers
+ * registered that way, and the async writer reads this vector concurrently.
  */
 extern std::vector<std::unique_ptr<ILogger>> MainLoggers;
 
+namespace detail {
+
+/* MainLoggers.size(), updated under the log lock so reporting threads can test it without taking the lock */
+extern std::atomic_size_t MainLoggerCount;
+
+} // namespace detail
+
 /**
  * @brief Centralized error counter
  *
@@ -121,16 +339,49 @@ inline uint64_t GetLogCounter() { return _LogCounter; }
 /**
  * @brief Restore centralized logger vector to default state (silent operation)
  */
-inline void UnregisterLoggers() { MainLoggers.clear(); }
+inline void UnregisterLoggers() {
+  auto lk = LockLog();
+  MainLoggers.clear();
+  detail::MainLoggerCount.store(0, std::memory_order_release);
+}
+
+/**
+ * @brief Append a logger to MainLoggers under the log lock
+ */
+void RegisterLogger(std::unique_ptr<ILogger> logger);
 
 /**
  * @brief Construct and register a real-time console logger singleton
  *
  * This will output to stderr on POSIX platforms and spawn a new console window on Windows.
  * If there's already a registered console logger, this is a no-op.
+ * ANSI colors are only used when stderr is a terminal.
  */
 void RegisterConsoleLogger();
 
+/**
+ * @brief Output policy for RegisterConsoleLogger
+ */
+struct ConsoleOptions {
+  bool batched = false;                        /**< Collect lines in a buffer instead of flushing stderr per record */
+  size_t bufferSize = 64 << 10;                /**< Batched: buffer capacity in bytes */
+  std::chrono::milliseconds flushInterval{50}; /**< Batched: write out lines buffered this long, 0 to disable */
+  Level flushLevel = Warning;                  /**< Batched: write out immediately at this severity or above */
+};
+
+/**
+ * @brief Construct and register the console logger with an output policy
+ * @param options Buffering and flush policy
+ *
+ * In batched mode, lines reach stderr in one write per flush: when the buffer is full, at
+ * flushLevel or above, or from a background thread once the oldest line has waited for
+ * flushInterval. Fatal reports are always written before the process aborts, and the crash
+ * handlers write out buffered lines before their own. The legacy Windows console, which colors
+ * lines through console attributes, is always written per record. No-op if a console logger is
+ * registered.
+ */
+void RegisterConsoleLogger(const ConsoleOptions& options);
+
 /**
  * @brief Construct and register a file logger
  * @param filepath Path to write the file
@@ -139,11 +390,364 @@ void RegisterConsoleLogger();
  */
 void RegisterFileLogger(const char* filepath);
 
+/**
+ * @brief Construct and register a compact binary file logger
+ * @param filepath Path to write the file
+ *
+ * Format strings, module, thread and source file names and captured stacks are written once and
+ * referenced by ID; arguments are stored in binary form without formatting. Use the
+ * logvisor-decode tool to reproduce the text FileLogger would have written, or JSON.
+ */
+void RegisterBinaryFileLogger(const char* filepath);
+
+/**
+ * @brief Buffer size and flush policy for RegisterBufferedFileLogger
+ */
+struct BufferedFileOptions {
+  size_t bufferSize = 1 << 20;                    /**< Userspace buffer capacity in bytes */
+  size_t flushBytes = 256 << 10;                  /**< Write out once this much is buffered, 0 when full */
+  std::chrono::milliseconds flushInterval{1000};  /**< Write out data buffered this long, 0 to disable */
+  Level flushLevel = Warning;                     /**< Write out immediately at this severity or above */
+};
+
+/**
+ * @brief I/O counters kept by RegisterBufferedFileLogger and RegisterUringFileLogger
+ */
+struct FileSinkCounters {
+  std::atomic_uint64_t bytesWritten{0}; /**< Bytes accepted by the OS */
+  std::atomic_uint64_t writeCalls{0};   /**< Write requests issued to the OS, including failed ones */
+};
+
+/**
+ * @brief Construct and register a file logger writing through its own buffer to an O_APPEND descriptor
+ * @param filepath Path to write the file
+ * @param options Buffer size and flush policy
+ * @return Counters for this logger, valid even after it is unregistered
+ *
+ * Output is identical to RegisterFileLogger. Records are collected in a fixed userspace buffer
+ * and written with one write() per flush; a record larger than the buffer is written directly.
+ * A background thread writes out data that has been buffered longer than flushInterval while
+ * nothing else is logged. Unlike stdio, the buffer is flushed before a Fatal report aborts.
+ */
+std::shared_ptr<const FileSinkCounters> RegisterBufferedFileLogger(const char* filepath,
+                                                                  const BufferedFileOptions& options = {});
+
+/**
+ * @brief Block size and flush policy for RegisterUringFileLogger
+ */
+struct UringFileOptions {
+  size_t blockSize = 1 << 20; /**< Bytes collected before a block is submitted */
+  unsigned blockCount = 8;    /**< Blocks registered with the kernel; reporting waits when all are in flight */
+  Level flushLevel = Warning; /**< Submit the partial block immediately at this severity or above */
+};
+
+/**
+ * @brief Construct and register a file logger that submits writes through io_uring
+ * @param filepath Path to write the file
+ * @param options Block size and flush policy
+ * @return Counters for this logger, valid even after it is unregistered
+ *
+ * Output is identical to RegisterFileLogger. Records are collected in registered buffers and each
+ * full block is submitted as one asynchronous write; completions are reaped without blocking while
+ * logging. Fatal reports wait for every block to reach the file. Falls back to synchronous writes
+ * when io_uring is unavailable at runtime, and to RegisterBufferedFileLogger on other platforms.
+ */
+std::shared_ptr<const FileSinkCounters> RegisterUringFileLogger(const char* filepath,
+                                                               const UringFileOptions& options = {});
+
+/**
+ * @brief Construct and register a file logger that writes records directly into a shared mapping of the file
+ * @param filepath Path to write the file
+ * @param chunkSize Bytes the file is extended by whenever the mapping fills up
+ *
+ * Output is identical to RegisterFileLogger, but each record is copied into the page cache as it is
+ * reported, so it survives the process being killed without any write() calls. The file is preallocated
+ * in chunks and zero-padded until the logger is destroyed; when reopening a file left behind by a crash,
+ * writing resumes after the last complete record. Falls back to RegisterFileLogger on platforms without mmap.
+ */
+void RegisterMappedFileLogger(const char* filepath, size_t chunkSize = 16 << 20);
+
+/**
+ * @brief Rollover, compression and retention policy for RegisterRotatingFileLogger
+ */
+struct RotatingFileOptions {
+  uint64_t maxFileSize = 64 << 20;   /**< Roll over before the file would exceed this size, 0 to disable */
+  std::chrono::seconds interval{0};  /**< Roll over once the file has been open this long, 0 to disable */
+  bool compress = true;              /**< Gzip closed segments (only when built with zlib) */
+  unsigned maxFiles = 10;            /**< Closed segments to keep, 0 for no limit */
+  uint64_t maxTotalBytes = 0;        /**< Combined size of closed segments to keep, 0 for no limit */
+  bool reopenOnSighup = true;        /**< Install a SIGHUP handler calling ReopenLogFiles, unless one exists */
+};
+
+/**
+ * @brief Construct and register a file logger that rolls over into numbered segments
+ * @param filepath Path of the active file; closed segments are named filepath.1, filepath.2, ...
+ * @param options Rollover, compression and retention policy
+ *
+ * Output is identical to RegisterFileLogger. Rolling over only closes, renames and reopens the file
+ * on the reporting thread; compressing closed segments to .gz and deleting the oldest ones beyond
+ * the retention limits happens on a low-priority background thread. Numbering continues after
+ * segments left by earlier runs.
+ */
+void RegisterRotatingFileLogger(const char* filepath, const RotatingFileOptions& options = {});
+
+/**
+ * @brief Make rotating file loggers reopen their file before the next record
+ *
+ * For cooperation with external tools like logrotate. Async-signal-safe.
+ */
+void ReopenLogFiles();
+
+/**
+ * @brief Set per-module severity thresholds
+ * @param spec Comma-separated list of name=level pairs, e.g. "gfx=warn,gfx.shader=info,*=error"
+ *
+ * Module names are matched on dot-separated components and the most specific entry wins;
+ * "*" sets the default for unmatched modules. Levels are info, warn, error and fatal (or off).
+ * Replaces the previous spec, including any Module::setLevel overrides. Until this is called,
+ * the spec is read from the LOGVISOR_LEVELS environment variable.
+ */
+void SetLogLevels(const char* spec);
+
+/**
+ * @brief Ring size and capture policy for EnableFlightRecorder
+ */
+struct FlightRecorderOptions {
+  size_t records = 4096;           /**< Records kept, rounded up to a power of two */
+  size_t recordSize = 256;         /**< Bytes per record including its header; longer messages are truncated */
+  Level level = Info;              /**< Lowest severity captured, regardless of module thresholds */
+  const char* dumpPath = nullptr;  /**< File the ring is appended to on the fatal path, nullptr for stderr */
+};
+
+/**
+ * @brief Keep the most recent records in a preallocated in-memory ring and dump it on the fatal path
+ * @param options Ring size and capture policy
+ *
+ * Records are captured by the reporting thread before module thresholds are applied and before
+ * any logger is involved, so the ring also holds levels that were filtered out. Arguments that
+ * can be deferred (see EnableAsyncLogging) are copied in binary form and only formatted when the
+ * ring is dumped. logvisorAbort() dumps the ring before printing the backtrace. The crash handlers
+ * installed by RegisterStandardExceptions dump it without fmt or stdio, so there records with
+ * deferred arguments show only their format string. The ring is sized by the first call; later
+ * calls only change level and dumpPath.
+ */
+void EnableFlightRecorder(const FlightRecorderOptions& options = {});
+
+/**
+ * @brief Stop capturing into the flight recorder; records already captured are kept
+ */
+void DisableFlightRecorder();
+
+/**
+ * @brief Write the flight recorder's records, oldest first, in FileLogger format
+ *
+ * No-op if the flight recorder was never enabled.
+ */
+void DumpFlightRecorder();
+
+/**
+ * @brief What a reporting thread does when the async queue is full
+ */
+enum class Backpressure {
+  Block,        /**< Wait for the writer thread to make room */
+  BlockTimeout, /**< Wait up to AsyncLoggingOptions::blockTimeout, then drop the record */
+  DropNewest,   /**< Drop the record being reported */
+  DropOldest,   /**< Discard the oldest queued record, whatever its severity, to make room */
+  Spill         /**< Append the record to AsyncLoggingOptions::overflowPath on the reporting thread */
+};
+
+/**
+ * @brief Queue size and backpressure policy for EnableAsyncLogging
+ */
+struct AsyncLoggingOptions {
+  size_t capacity = 8192;       /**< Records the queue can hold, rounded up to a power of two */
+  bool deferFormatting = false; /**< Copy arguments in binary form and run fmt on the writer thread */
+  /** Policy for Info, Warning and Error records; Fatal is always delivered synchronously */
+  std::array<Backpressure, 3> policies{Backpressure::Block, Backpressure::Block, Backpressure::Block};
+  std::chrono::milliseconds blockTimeout{10}; /**< Longest wait under Backpressure::BlockTimeout */
+  const char* overflowPath = nullptr;         /**< File for Backpressure::Spill; records are dropped without one */
+};
+
+/**
+ * @brief Deliver log events to MainLoggers from a dedicated writer thread
+ * @param capacity Number of records the queue can hold, rounded up to a power of two
+ * @param deferFormatting Copy arguments in binary form and run fmt on the writer thread
+ *
+ * Reporting threads only format the message and enqueue it into a bounded lock-free queue;
+ * they wait only if the queue is full. Fatal events drain the queue and are delivered
+ * synchronously before logvisorAbort() runs. The capacity is fixed by the first call.
+ *
+ * With deferFormatting, Module::report serializes its arguments instead of formatting them
+ * when every argument is an arithmetic value, void pointer, string, or a type opted in
+ * through DeferredFormattable. Other calls are formatted eagerly as before.
+ */
+void EnableAsyncLogging(size_t capacity = 8192, bool deferFormatting = false);
+
+/**
+ * @brief EnableAsyncLogging with a per-severity policy for a full queue
+ *
+ * Records lost to a full queue are counted in LogStats. The writer thread reports them with a
+ * Warning from module "logvisor" (a gap marker) at the point in the stream where they went
+ * missing. Spilled records keep FileLogger's line format, and the gap marker names the overflow
+ * file.
+ */
+void EnableAsyncLogging(const AsyncLoggingOptions& options);
+
+/**
+ * @brief Deliver all queued events, stop the writer thread and return to synchronous logging
+ */
+void DisableAsyncLogging();
+
+/**
+ * @brief Block until every event reported before this call has been delivered to MainLoggers
+ *
+ * No-op in synchronous mode.
+ */
+void FlushLog();
+
+/**
+ * @brief Log-linear histogram of durations in nanoseconds
+ *
+ * Every power of two is split into SubBuckets linear buckets, so values are resolved to within
+ * 12.5% across the whole range.
+ */
+struct LatencyHistogram {
+  static constexpr unsigned SubBucketBits = 3;
+  static constexpr unsigned SubBuckets = 1u << SubBucketBits;
+  static constexpr unsigned BucketCount = (64 - SubBucketBits + 1) * SubBuckets;
+
+  std::array<uint64_t, BucketCount> counts{}; /**< Samples per bucket */
+  uint64_t count = 0;                         /**< Total samples */
+  uint64_t totalNs = 0;                       /**< Sum of all samples */
+  uint64_t maxNs = 0;                         /**< Largest sample */
+
+  /**
+   * @brief Smallest duration falling into a bucket
+   */
+  static constexpr uint64_t BucketLowerBound(unsigned index) {
+    if (index < SubBuckets)
+      return index;
+    return uint64_t(SubBuckets + (index & (SubBuckets - 1))) << ((index >> SubBucketBits) - 1);
+  }
+
+  /**
+   * @brief Upper bound of the bucket holding the given fraction of samples, e.g. 0.99 for p99
+   */
+  uint64_t percentile(double fraction) const {
+    if (count == 0)
+      return 0;
+    const uint64_t rank = uint64_t(fraction * double(count - 1)) + 1;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i + 1 < BucketCount; ++i) {
+      seen += counts[i];
+      if (seen >= rank) {
+        const uint64_t upper = BucketLowerBound(i + 1) - 1;
+        return upper < maxNs ? upper : maxNs;
+      }
+    }
+    return maxNs;
+  }
+
+  double meanNs() const { return count ? double(totalNs) / double(count) : 0.0; }
+};
+
+/**
+ * @brief Statistics of one registered logger
+ */
+struct SinkStats {
+  const char* name = nullptr; /**< ILogger::sinkName */
+  uint64_t typeId = 0;        /**< ILogger::getTypeId */
+  uint64_t bytes = 0;         /**< Output produced, for loggers that call countBytes */
+  LatencyHistogram latency;   /**< Time spent in reportRecord; count is the number of records */
+};
+
+/**
+ * @brief Records delivered from one module
+ */
+struct ModuleStats {
+  std::string name;
+  std::array<uint64_t, 4> records{}; /**< Indexed by Level */
+};
+
+/**
+ * @brief Snapshot of logging activity since startup
+ */
+struct LogStats {
+  std::array<uint64_t, 4> records{}; /**< Records delivered to MainLoggers, indexed by Level */
+  std::vector<ModuleStats> modules;  /**< Sorted by name */
+  std::vector<SinkStats> sinks;      /**< Currently registered loggers, in MainLoggers order */
+  LatencyHistogram lockWait;         /**< Time spent acquiring the log lock to deliver a record */
+  uint64_t discarded = 0;            /**< Records dropped because MainLoggers was empty */
+  std::array<uint64_t, 3> queueDropped{}; /**< Records dropped by async backpressure, indexed by Level */
+  uint64_t queueSpilled = 0;              /**< Records written to the async overflow file */
+};
+
+/**
+ * @brief Collect logging statistics
+ *
+ * Counters are updated by the thread delivering a record while it holds the log lock anyway, or
+ * in sharded counters for records discarded before taking it, so keeping them adds no
+ * contention. Collection reads the module and level counters without locking and holds the log
+ * lock only to walk MainLoggers. Per-sink latency covers synchronous delivery and the async
+ * writer thread alike; lock waits are only measured where the delivering thread had to block.
+ */
+LogStats GetStats();
+
 /**
  * @brief Register signal handlers with system for common client exceptions
+ *
+ * On POSIX the handlers neither lock nor allocate. Every built-in text logger writes out what it
+ * is buffering followed by the Fatal line through ILogger::reportSignalSafe; the binary file logger
+ * loses the records still held in its stdio buffer. The process then ends with _exit, or with the
+ * original signal in debug builds.
  */
 void RegisterStandardExceptions();
 
+/**
+ * @brief Print raw backtraces on the fatal path and leave symbolization to logvisor-symbolize
+ *
+ * Records the load base, address range and build ID of every loaded module once, here. From
+ * then on logvisorAbort() and the handlers installed by RegisterStandardExceptions print each
+ * frame as a raw address plus the module it falls in, without reading any symbol table, so
+ * stripped binaries can be shipped and resolved later against their unstripped builds. Call
+ * again after loading libraries whose frames should be attributed. Linux only; elsewhere
+ * backtraces are printed as before.
+ */
+void EnableDeferredSymbolization();
+
+/**
+ * @brief Which reports get a backtrace, for EnableStackCapture
+ */
+struct StackCaptureOptions {
+  Level level = Error;       /**< Lowest severity captured */
+  unsigned maxFrames = 32;   /**< Frames kept per stack, at most 128 */
+  bool framePointers = true; /**< Walk frame pointers when the build keeps them; otherwise use unwind tables */
+};
+
+/**
+ * @brief Attach a backtrace to every report at or above options.level
+ * @param options Capture policy
+ *
+ * Stacks are captured on the reporting thread by walking frame pointers where logvisor was built
+ * with them (checked once, here), falling back to the platform unwinder for frames without them.
+ * Neither path symbolizes or takes the log lock. Each distinct stack is interned once into a
+ * process-wide table and records only carry its ID in LogRecord::stackId; text loggers print the
+ * symbolized frames the first time a stack appears in each file they write (including every
+ * rotated segment and reopened file) and a "(stack N)" reference after that.
+ * Frame pointer walks stop at code loaded after this call; call again after loading libraries.
+ */
+void EnableStackCapture(const StackCaptureOptions& options = {});
+
+/**
+ * @brief Stop attaching backtraces; stacks already interned stay resolvable
+ */
+void DisableStackCapture();
+
+/**
+ * @brief Return addresses of an interned stack, innermost first; empty for unknown IDs
+ */
+std::vector<void*> GetStackFrames(uint32_t stackId);
+
 #if SENTRY_ENABLED
 /**
  * @brief Register Sentry crash reporting & logging.
@@ -161,67 +765,551 @@ void RegisterSentry(const char* appName, const char* appVersion, const char* cac
 void CreateWin32Console();
 #endif
 
+/**
+ * @brief Specialize as std::true_type to let deferred formatting copy T by value
+ *
+ * T must be trivially copyable and its formatter must only depend on the object's bytes
+ * (no pointers to data that may not outlive the report call).
+ */
+template <typename T>
+struct DeferredFormattable : std::false_type {};
+
+namespace detail {
+
+extern std::atomic_bool DeferFormatting;
+
+using DeferredEncodeFunc = void (*)(uint8_t* dst, const void* args);
+using DeferredArgsFunc = void (*)(fmt::format_args args, void* context);
+/* Decodes an encoded argument pack and passes it to use, valid only for that call */
+using DeferredDecodeFunc = void (*)(const uint8_t* src, DeferredArgsFunc use, void* context);
+
+/**
+ * @brief Enqueue a serialized argument pack for formatting on the writer thread
+ * @return false if deferred mode is inactive and the caller must report eagerly
+ */
+bool DeferReport(const char* modName, Level severity, const char* file, unsigned linenum, const CallSite* site,
+                 fmt::string_view format, bool formatIsStatic, size_t argsSize, DeferredEncodeFunc encode,
+                 const void* args, DeferredDecodeFunc decode);
+
+/* Copies of trivially copyable arguments, reconstructed in suitably aligned storage */
+template <typename T>
+class DeferredValue {
+  alignas(T) unsigned char m_storage[sizeof(T)];
+
+public:
+  explicit DeferredValue(const uint8_t*& src) {
+    std::memcpy(m_storage, src, sizeof(T));
+    src += sizeof(T);
+  }
+  const T& get() const { return *std::launder(reinterpret_cast<const T*>(m_storage)); }
+};
+
+/* Strings are copied inline as a length-prefixed byte run and formatted as a view of it */
+class DeferredString {
+  fmt::string_view m_view;
+
+public:
+  explicit DeferredString(const uint8_t*& src) {
+    uint32_t len;
+    std::memcpy(&len, src, sizeof(len));
+    m_view = fmt::string_view(reinterpret_cast<const char*>(src + sizeof(len)), len);
+    src += sizeof(len) + len;
+  }
+  const fmt::string_view& get() const { return m_view; }
+
+  static size_t size(std::string_view str) { return sizeof(uint32_t) + str.size(); }
+  static uint8_t* encode(uint8_t* dst, std::string_view str) {
+    const auto len = uint32_t(str.size());
+    std::memcpy(dst, &len, sizeof(len));
+    std::memcpy(dst + sizeof(len), str.data(), len);
+    return dst + sizeof(len) + len;
+  }
+};
+
+template <typename T, typename = void>
+struct DeferredArg {
+  static constexpr bool Supported = false;
+};
+
+template <typename T>
+struct DeferredArg<T, std::enable_if_t<std::is_arithmetic_v<T> || std::is_same_v<T, void*> ||
+                                       std::is_same_v<T, const void*> || std::is_same_v<T, std::nullptr_t> ||
+                                       DeferredFormattable<T>::value>> {
+  static_assert(std::is_trivially_copyable_v<T>, "DeferredFormattable types must be trivially copyable");
+  static constexpr bool Supported = true;
+  using Holder = DeferredValue<T>;
+  static size_t size(const T&) { return sizeof(T); }
+  static uint8_t* encode(uint8_t* dst, const T& val) {
+    std::memcpy(dst, &val, sizeof(T));
+    return dst + sizeof(T);
+  }
+};
+
+template <typename T>
+struct DeferredStringArg {
+  static constexpr bool Supported = true;
+  using Holder = DeferredString;
+  static std::string_view view(const T& val) {
+    if constexpr (std::is_pointer_v<T>)
+      return val ? std::string_view(val) : std::string_view();
+    else if constexpr (std::is_array_v<T>)
+      return std::string_view(val);
+    else
+      return std::string_view(val.data(), val.size());
+  }
+  static size_t size(const T& val) { return DeferredString::size(view(val)); }
+  static uint8_t* encode(uint8_t* dst, const T& val) { return DeferredString::encode(dst, view(val)); }
+};
+
+template <>
+struct DeferredArg<char*> : DeferredStringArg<char*> {};
+template <>
+struct DeferredArg<const char*> : DeferredStringArg<const char*> {};
+template <size_t N>
+struct DeferredArg<char[N]> : DeferredStringArg<char[N]> {};
+template <typename Traits, typename Alloc>
+struct DeferredArg<std::basic_string<char, Traits, Alloc>>
+: DeferredStringArg<std::basic_string<char, Traits, Alloc>> {};
+template <typename Traits>
+struct DeferredArg<std::basic_string_view<char, Traits>> : DeferredStringArg<std::basic_string_view<char, Traits>> {};
+template <>
+struct DeferredArg<fmt::string_view> : DeferredStringArg<fmt::string_view> {};
+
+template <typename T>
+using DeferredArgOf = DeferredArg<std::remove_cv_t<std::remove_reference_t<T>>>;
+
+template <typename Char, typename... Args>
+constexpr bool IsDeferrable = std::is_same_v<Char, char> && (DeferredArgOf<Args>::Supported && ...);
+
+template <typename... Args>
+struct DeferredPack {
+  using Refs = std::tuple<const std::remove_reference_t<Args>&...>;
+
+  static size_t size(const std::remove_reference_t<Args>&... args) {
+    return (size_t(0) + ... + DeferredArgOf<Args>::size(args));
+  }
+
+  static void encode(uint8_t* dst, const void* argsPtr) {
+    std::apply([&](const auto&... args) { ((dst = DeferredArgOf<Args>::encode(dst, args)), ...); },
+               *static_cast<const Refs*>(argsPtr));
+  }
+
+  static void decode([[maybe_unused]] const uint8_t* src, DeferredArgsFunc use, void* context) {
+    /* Braced initialization decodes the holders in argument order */
+    const std::tuple<typename DeferredArgOf<Args>::Holder...> held{typename DeferredArgOf<Args>::Holder(src)...};
+    std::apply([&](const auto&... holders) { use(fmt::make_format_args(holders.get()...), context); }, held);
+  }
+};
+
+/* Format strings from FMT_STRING have static storage and need not be copied */
+#if FMT_VERSION >= 90000
+template <typename S>
+constexpr bool IsCompileString = fmt::detail::is_compile_string<S>::value;
+#else
+template <typename S>
+constexpr bool IsCompileString = fmt::is_compile_string<S>::value;
+#endif
+
+template <typename Char, typename S, typename... Args>
+LOGVISOR_ALWAYS_INLINE bool TryDefer(const char* modName, Level severity, const char* file, unsigned linenum,
+                                     const CallSite* site, const S& format, const Args&... args) {
+  using Pack = DeferredPack<Args...>;
+  const typename Pack::Refs refs(args...);
+  /* Call sites pass their own static view so loggers can match rec.format against it */
+  return DeferReport(modName, severity, file, linenum, site, site ? site->format : fmt::to_string_view<Char>(format),
+                     site || IsCompileString<S>, Pack::size(args...), Pack::encode, &refs, Pack::decode);
+}
+
+/* Lowest Level captured by the flight recorder; above Fatal while it is disabled */
+extern std::atomic_int FlightRecorderLevel;
+
+inline bool FlightRecording(Level severity) {
+  return int(severity) >= FlightRecorderLevel.load(std::memory_order_relaxed);
+}
+
+void FlightRecordFormatted(const char* modName, Level severity, const char* file, unsigned linenum,
+                           fmt::string_view format, fmt::format_args args);
+
+void FlightRecordDeferred(const char* modName, Level severity, const char* file, unsigned linenum,
+                          fmt::string_view format, size_t argsSize, DeferredEncodeFunc encode, const void* args,
+                          DeferredDecodeFunc decode);
+
+/* Arguments are copied in binary form when possible and only formatted if the ring is dumped */
+template <typename Char, typename S, typename... Args>
+void FlightCapture(const char* modName, Level severity, const char* file, unsigned linenum, const CallSite* site,
+                   const S& format, const Args&... args) {
+  if constexpr (IsDeferrable<Char, Args...>) {
+    if (site || IsCompileString<S>) {
+      using Pack = DeferredPack<Args...>;
+      const typename Pack::Refs refs(args...);
+      FlightRecordDeferred(modName, severity, file, linenum, site ? site->format : fmt::to_string_view<Char>(format),
+                           Pack::size(args...), Pack::encode, &refs, Pack::decode);
+      return;
+    }
+  }
+  FlightRecordFormatted(modName, severity, file, linenum, fmt::to_string_view<Char>(format),
+                        fmt::make_args_checked<Args...>(format, args...));
+}
+
+/* Counts a record dropped because MainLoggers was empty, for LogStats::discarded */
+void CountDiscarded();
+
+void FlightRecordFields(const char* modName, Level severity, const char* file, unsigned linenum,
+                        fmt::string_view message, const Field* fields, size_t count);
+
+} // namespace detail
+
+/**
+ * @brief Deliver an event to MainLoggers, directly or through the asynchronous writer
+ *
+ * Also performs error accounting and aborts on Fatal severity.
+ */
+void _DispatchReport(const char* modName, Level severity, const char* file, unsigned linenum, const CallSite* site,
+                     fmt::string_view format, fmt::format_args args);
+
+/**
+ * @brief _DispatchReport for a structured report with a plain message and typed fields
+ */
+void _DispatchFields(const char* modName, Level severity, const char* file, unsigned linenum, fmt::string_view message,
+                     const Field* fields, size_t count);
+
+/**
+ * @brief Admission policy for a RateLimiter
+ */
+struct RateLimit {
+  double perSecond = 10.0; /**< Sustained messages admitted per second, 0 for no rate limit */
+  unsigned burst = 20;     /**< Messages admitted back to back before perSecond applies */
+  std::chrono::milliseconds duplicateWindow{1000}; /**< Repeats of the last admitted message are dropped for this long, 0 to keep them */
+  std::chrono::milliseconds summaryInterval{1000}; /**< Longest a running count of dropped messages goes unreported */
+};
+
+namespace detail {
+
+inline uint64_t HashBytes(uint64_t hash, const void* data, size_t size) {
+  const auto* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; ++i)
+    hash = (hash ^ bytes[i]) * 0x100000001b3;
+  return hash;
+}
+
+template <typename T>
+bool HashArg(uint64_t& hash, const T& val) {
+  if constexpr (std::is_convertible_v<const T&, const char*>) {
+    const char* str = val;
+    const size_t size = str ? std::strlen(str) : 0;
+    hash = HashBytes(HashBytes(hash, &size, sizeof(size)), str, size);
+  } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+    const std::string_view str(val);
+    const size_t size = str.size();
+    hash = HashBytes(HashBytes(hash, &size, sizeof(size)), str.data(), size);
+  } else if constexpr (std::is_arithmetic_v<T> || std::is_enum_v<T> || std::is_pointer_v<T>) {
+    hash = HashBytes(hash, &val, sizeof(val));
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/* Identifies a message by its arguments without formatting it; 0 if some argument can't be hashed */
+template <typename... Args>
+uint64_t HashArgs(const Args&... args) {
+  uint64_t hash = 0xcbf29ce484222325;
+  if (!(HashArg(hash, args) && ...))
+    return 0;
+  return hash | 1;
+}
+
+} // namespace detail
+
+/**
+ * @brief Rate limit and duplicate suppression state of one call site
+ *
+ * Must have static storage duration; LOGVISOR_REPORT_LIMITED declares one per call site. The
+ * admission decision is a few relaxed atomic operations on this object, taken before the message
+ * is formatted or the log lock is acquired. A token bucket of perSecond tokens and burst capacity
+ * bounds the rate, and a message whose arguments equal the last admitted one is dropped within
+ * duplicateWindow. Dropped messages are counted and reported as "suppressed N similar messages"
+ * at the call site's severity, at most once per summaryInterval by the next call through the
+ * limiter, or by ReportSuppressedMessages() once the call site has gone quiet. Dropped Error
+ * messages still count toward ErrorCount; the summaries do not.
+ */
+class RateLimiter {
+  friend void ReportSuppressedMessages();
+
+  RateLimit m_limit;
+  std::atomic<int64_t> m_nextArrival{0}; /* Token bucket as a theoretical arrival time, in steady clock ns */
+  std::atomic<uint64_t> m_lastHash{0};
+  std::atomic<int64_t> m_lastAdmitted{0};
+  std::atomic<uint64_t> m_suppressed{0};
+  std::atomic<int64_t> m_lastSummary{0};
+  std::atomic_bool m_registered{false};
+  RateLimiter* m_next = nullptr;
+  const Module* m_module = nullptr;
+  Level m_severity = Info;
+  const char* m_file = nullptr;
+  unsigned m_linenum = 0;
+  const CallSite* m_site = nullptr;
+
+  void _reportSuppressed(const Module& module, Level severity, const char* file, unsigned linenum,
+                         const CallSite* site);
+  void _summarize(const Module& module, Level severity, const char* file, unsigned linenum, const CallSite* site,
+                  int64_t now);
+
+public:
+  constexpr explicit RateLimiter(const RateLimit& limit = {}) : m_limit(limit) {}
+  RateLimiter(const RateLimiter&) = delete;
+  RateLimiter& operator=(const RateLimiter&) = delete;
+
+  /**
+   * @brief Decide whether a message passes, reporting the pending drop count first when it is due
+   * @param argsHash detail::HashArgs of the message's arguments, 0 to skip duplicate detection
+   */
+  bool admit(const Module& module, Level severity, const char* file, unsigned linenum, const CallSite* site,
+             uint64_t argsHash);
+};
+
+/**
+ * @brief Report the drop counts every RateLimiter has accumulated since its last summary
+ *
+ * Covers call sites that went quiet while dropping; call it periodically, e.g. once per frame.
+ */
+void ReportSuppressedMessages();
+
+namespace detail {
+
+uint64_t SeedRandom();
+
+/* xorshift64* on per-thread state; not for anything but sampling */
+inline uint64_t NextRandom() {
+  static thread_local uint64_t State = 0;
+  if (!State)
+    State = SeedRandom();
+  State ^= State >> 12;
+  State ^= State << 25;
+  State ^= State >> 27;
+  return State * 0x2545f4914f6cdd1d;
+}
+
+} // namespace detail
+
+/**
+ * @brief Sampling state of one call site
+ *
+ * Must have static storage duration; LOGVISOR_REPORT_SAMPLED declares one per call site from
+ * one of the factory functions. sample() is decided before the report's arguments are evaluated
+ * and costs one relaxed atomic increment, or one step of a per-thread PRNG for Probability.
+ * Records from the call site carry rate() as LogRecord::sampleRate, so counts can be scaled back
+ * up by 1 / sampleRate.
+ */
+class Sampler {
+public:
+  enum class Mode { EveryNth, Probability, FirstPerFrame };
+
+private:
+  Mode m_mode;
+  uint32_t m_count;
+  float m_probability;
+  uint64_t m_threshold;
+  std::atomic<uint64_t> m_calls{0};
+  std::atomic<uint64_t> m_frame{UINT64_MAX};
+  std::atomic<uint32_t> m_frameCalls{0};
+  std::atomic<uint32_t> m_prevFrameCalls{0};
+
+  constexpr Sampler(Mode mode, uint32_t count, double probability)
+  : m_mode(mode)
+  , m_count(count ? count : 1)
+  , m_probability(float(probability))
+  , m_threshold(probability >= 1.0   ? UINT64_MAX
+                : probability <= 0.0 ? 0
+                                     : uint64_t(probability * 18446744073709551616.0)) {}
+
+public:
+  /**
+   * @brief Report the first of every count calls
+   */
+  static constexpr Sampler EveryNth(uint32_t count) { return Sampler(Mode::EveryNth, count, 1.0); }
+
+  /**
+   * @brief Report each call independently with the given probability
+   */
+  static constexpr Sampler Probability(double probability) { return Sampler(Mode::Probability, 1, probability); }
+
+  /**
+   * @brief Report the first count calls after each FrameIndex change
+   */
+  static constexpr Sampler FirstPerFrame(uint32_t count) { return Sampler(Mode::FirstPerFrame, count, 1.0); }
+
+  Sampler(const Sampler&) = delete;
+  Sampler& operator=(const Sampler&) = delete;
+
+  bool sample() {
+    switch (m_mode) {
+    case Mode::EveryNth:
+      return m_calls.fetch_add(1, std::memory_order_relaxed) % m_count == 0;
+    case Mode::Probability:
+      return m_threshold == UINT64_MAX || detail::NextRandom() < m_threshold;
+    case Mode::FirstPerFrame: {
+      const uint64_t frame = FrameIndex.load(std::memory_order_relaxed);
+      uint64_t seen = m_frame.load(std::memory_order_relaxed);
+      if (seen != frame && m_frame.compare_exchange_strong(seen, frame, std::memory_order_relaxed))
+        m_prevFrameCalls.store(m_frameCalls.exchange(0, std::memory_order_relaxed), std::memory_order_relaxed);
+      return m_frameCalls.fetch_add(1, std::memory_order_relaxed) < m_count;
+    }
+    }
+    return true;
+  }
+
+  /**
+   * @brief Fraction of calls reported
+   *
+   * Exact for EveryNth and Probability. For FirstPerFrame, estimated from the number of calls
+   * in the previous frame.
+   */
+  float rate() const {
+    switch (m_mode) {
+    case Mode::EveryNth:
+      return 1.0f / float(m_count);
+    case Mode::Probability:
+      return m_probability;
+    case Mode::FirstPerFrame: {
+      const uint32_t prevCalls = m_prevFrameCalls.load(std::memory_order_relaxed);
+      return prevCalls > m_count ? float(m_count) / float(prevCalls) : 1.0f;
+    }
+    }
+    return 1.0f;
+  }
+};
+
 /**
  * @brief This is constructed per-subsystem in a locally centralized fashion
  */
 class Module {
+  friend struct ModuleRegistry;
+
   const char* m_modName;
+  /* Lowest enabled Level, or -1 until resolved against the level spec */
+  mutable std::atomic_int m_threshold{-1};
+  mutable const Module* m_nextRegistered = nullptr;
+  mutable bool m_registered = false;
+
+  int _resolveThreshold() const;
+
+  /* Threshold check, counting records that pass it while no logger is registered */
+  bool _deliverable(Level severity) const {
+    if (!enabled(severity))
+      return false;
+    if (detail::MainLoggerCount.load(std::memory_order_acquire) == 0 && severity != Level::Fatal) {
+      detail::CountDiscarded();
+      return false;
+    }
+    return true;
+  }
 
   template <typename Char>
-  void _vreport(Level severity, fmt::basic_string_view<Char> format,
-                fmt::basic_format_args<fmt::buffer_context<Char>> args) {
-    auto lk = LockLog();
-    ++_LogCounter;
-    if (severity == Fatal)
-      RegisterConsoleLogger();
-    for (auto& logger : MainLoggers)
-      logger->report(m_modName, severity, format, args);
-    if (severity == Error || severity == Fatal)
-      logvisorBp();
-    if (severity == Fatal)
-      logvisorAbort();
-    else if (severity == Error)
-      ++ErrorCount;
+  LOGVISOR_ALWAYS_INLINE void _vreport(Level severity, fmt::basic_string_view<Char> format,
+                                       fmt::basic_format_args<fmt::buffer_context<Char>> args) {
+    _DispatchReport(m_modName, severity, nullptr, 0, nullptr, format, args);
   }
 
   template <typename Char>
-  void _vreportSource(Level severity, const char* file, unsigned linenum, fmt::basic_string_view<Char> format,
-                      fmt::basic_format_args<fmt::buffer_context<Char>> args) {
-    auto lk = LockLog();
-    ++_LogCounter;
-    if (severity == Fatal)
-      RegisterConsoleLogger();
-    for (auto& logger : MainLoggers)
-      logger->reportSource(m_modName, severity, file, linenum, format, args);
-    if (severity == Error || severity == Fatal)
-      logvisorBp();
-    if (severity == Fatal)
-      logvisorAbort();
-    else if (severity == Error)
-      ++ErrorCount;
+  LOGVISOR_ALWAYS_INLINE void _vreportSource(Level severity, const char* file, unsigned linenum,
+                                             fmt::basic_string_view<Char> format,
+                                             fmt::basic_format_args<fmt::buffer_context<Char>> args) {
+    _DispatchReport(m_modName, severity, file, linenum, nullptr, format, args);
+  }
+
+  template <typename Char>
+  LOGVISOR_ALWAYS_INLINE void _vreportSite(const CallSite& site, fmt::string_view format,
+                                           fmt::basic_format_args<fmt::buffer_context<Char>> args) {
+    _DispatchReport(m_modName, site.severity, site.file, site.linenum, &site, format, args);
+  }
+
+  LOGVISOR_ALWAYS_INLINE void _reportFields(Level severity, const char* file, unsigned linenum,
+                                            fmt::string_view message, const Field* fields, size_t count) {
+    if (detail::FlightRecording(severity))
+      detail::FlightRecordFields(m_modName, severity, file, linenum, message, fields, count);
+    if (!_deliverable(severity))
+      return;
+    _DispatchFields(m_modName, severity, file, linenum, message, fields, count);
   }
 
 public:
   constexpr Module(const char* modName) : m_modName(modName) {}
+  ~Module();
+  Module(const Module&) = delete;
+  Module& operator=(const Module&) = delete;
+
+  /**
+   * @brief Name given at construction
+   */
+  const char* name() const { return m_modName; }
+
+  /**
+   * @brief Check whether events of the given severity from this module reach the loggers
+   *
+   * A single relaxed load once the threshold has been resolved. Fatal is always enabled.
+   */
+  bool enabled(Level severity) const {
+    int threshold = m_threshold.load(std::memory_order_relaxed);
+    if (threshold < 0) {
+      if (severity == Fatal)
+        return true;
+      threshold = _resolveThreshold();
+    }
+    return severity >= threshold;
+  }
+
+  /**
+   * @brief Override the level spec for this module until the next SetLogLevels call
+   * @param threshold Lowest severity to report
+   */
+  void setLevel(Level threshold);
 
   /**
    * @brief Route new log message to centralized ILogger
    * @param severity Level of log report severity
    * @param format fmt-style format string
    */
-  template <typename S, typename... Args, typename Char = fmt::char_t<S>>
-  void report(Level severity, const S& format, Args&&... args) {
-    if (MainLoggers.empty() && severity != Level::Fatal)
+  template <typename S, typename... Args, typename Char = fmt::char_t<S>,
+            std::enable_if_t<!detail::HasFields<Args...>, int> = 0>
+  LOGVISOR_ALWAYS_INLINE void report(Level severity, const S& format, Args&&... args) {
+    if (detail::FlightRecording(severity))
+      detail::FlightCapture<Char>(m_modName, severity, nullptr, 0, nullptr, format, args...);
+    if (!_deliverable(severity))
       return;
+    if constexpr (detail::IsDeferrable<Char, Args...>) {
+      if (severity != Fatal && detail::DeferFormatting.load(std::memory_order_relaxed) &&
+          detail::TryDefer<Char>(m_modName, severity, nullptr, 0, nullptr, format, args...))
+        return;
+    }
     _vreport(severity, fmt::to_string_view<Char>(format),
              fmt::basic_format_args<fmt::buffer_context<Char>>(
                  fmt::make_args_checked<Args...>(format, std::forward<Args>(args)...)));
   }
 
+  /**
+   * @brief Route a structured event to centralized ILogger
+   * @param severity Level of log report severity
+   * @param message Constant description of the event, not a format string
+   * @param fields Values made with kv()
+   *
+   * e.g. report(Info, "asset loaded", kv("path", path), kv("ms", ms)). Fields are passed to
+   * loggers in typed form without being formatted or allocated; text loggers append them to the
+   * message as key=value.
+   */
+  template <typename... Fields,
+            std::enable_if_t<sizeof...(Fields) && (std::is_same_v<Fields, Field> && ...), int> = 0>
+  LOGVISOR_ALWAYS_INLINE void report(Level severity, fmt::string_view message, const Fields&... fields) {
+    const Field fieldArray[] = {fields...};
+    _reportFields(severity, nullptr, 0, message, fieldArray, sizeof...(Fields));
+  }
+
   template <typename Char>
-  void vreport(Level severity, fmt::basic_string_view<Char> format,
-               fmt::basic_format_args<fmt::buffer_context<Char>> args) {
-    if (MainLoggers.empty() && severity != Level::Fatal)
+  LOGVISOR_ALWAYS_INLINE void vreport(Level severity, fmt::basic_string_view<Char> format,
+                                      fmt::basic_format_args<fmt::buffer_context<Char>> args) {
+    if (detail::FlightRecording(severity))
+      detail::FlightRecordFormatted(m_modName, severity, nullptr, 0, format, args);
+    if (!_deliverable(severity))
       return;
     _vreport(severity, format, args);
   }
@@ -233,24 +1321,242 @@ public:
    * @param linenum Source line number from __LINE__ macro
    * @param format fmt-style format string
    */
-  template <typename S, typename... Args, typename Char = fmt::char_t<S>>
-  void reportSource(Level severity, const char* file, unsigned linenum, const S& format, Args&&... args) {
-    if (MainLoggers.empty() && severity != Level::Fatal)
+  template <typename S, typename... Args, typename Char = fmt::char_t<S>,
+            std::enable_if_t<!detail::HasFields<Args...>, int> = 0>
+  LOGVISOR_ALWAYS_INLINE void reportSource(Level severity, const char* file, unsigned linenum, const S& format,
+                                           Args&&... args) {
+    if (detail::FlightRecording(severity))
+      detail::FlightCapture<Char>(m_modName, severity, file, linenum, nullptr, format, args...);
+    if (!_deliverable(severity))
       return;
+    if constexpr (detail::IsDeferrable<Char, Args...>) {
+      if (severity != Fatal && detail::DeferFormatting.load(std::memory_order_relaxed) &&
+          detail::TryDefer<Char>(m_modName, severity, file, linenum, nullptr, format, args...))
+        return;
+    }
     _vreportSource(severity, file, linenum, fmt::to_string_view<Char>(format),
                    fmt::basic_format_args<fmt::buffer_context<Char>>(
                        fmt::make_args_checked<Args...>(format, std::forward<Args>(args)...)));
   }
 
+  /**
+   * @brief Structured report with source info
+   */
+  template <typename... Fields,
+            std::enable_if_t<sizeof...(Fields) && (std::is_same_v<Fields, Field> && ...), int> = 0>
+  LOGVISOR_ALWAYS_INLINE void reportSource(Level severity, const char* file, unsigned linenum, fmt::string_view message,
+                                           const Fields&... fields) {
+    const Field fieldArray[] = {fields...};
+    _reportFields(severity, file, linenum, message, fieldArray, sizeof...(Fields));
+  }
+
   template <typename Char>
-  void vreportSource(Level severity, const char* file, unsigned linenum, fmt::basic_string_view<Char> format,
-                     fmt::basic_format_args<fmt::buffer_context<Char>> args) {
-    if (MainLoggers.empty() && severity != Level::Fatal)
+  LOGVISOR_ALWAYS_INLINE void vreportSource(Level severity, const char* file, unsigned linenum,
+                                            fmt::basic_string_view<Char> format,
+                                            fmt::basic_format_args<fmt::buffer_context<Char>> args) {
+    if (detail::FlightRecording(severity))
+      detail::FlightRecordFormatted(m_modName, severity, file, linenum, format, args);
+    if (!_deliverable(severity))
       return;
     _vreportSource(severity, file, linenum, format, args);
   }
+
+  /**
+   * @brief Route new log message to centralized ILogger unless limiter drops it
+   * @param limiter Rate limiter with static storage duration standing for the call site
+   * @param severity Level of log report severity
+   * @param format fmt-style format string
+   *
+   * Fatal events are never dropped.
+   */
+  template <typename S, typename... Args, typename Char = fmt::char_t<S>>
+  LOGVISOR_ALWAYS_INLINE void reportLimited(RateLimiter& limiter, Level severity, const S& format, Args&&... args) {
+    if (severity != Fatal && (enabled(severity) || detail::FlightRecording(severity)) &&
+        !limiter.admit(*this, severity, nullptr, 0, nullptr, detail::HashArgs(args...)))
+      return;
+    report(severity, format, std::forward<Args>(args)...);
+  }
+
+  /**
+   * @brief Route new log message from a static call site to centralized ILogger
+   * @param site Call site descriptor providing severity, source location and format string
+   * @param format The call site's format string, wrapped in FMT_STRING for checking
+   *
+   * Normally invoked through LOGVISOR_REPORT.
+   */
+  template <typename S, typename... Args, typename Char = fmt::char_t<S>>
+  LOGVISOR_ALWAYS_INLINE void reportSite(const CallSite& site, const S& format, Args&&... args) {
+    if (detail::FlightRecording(site.severity))
+      detail::FlightCapture<Char>(m_modName, site.severity, site.file, site.linenum, &site, format, args...);
+    if (!_deliverable(site.severity))
+      return;
+    if constexpr (detail::IsDeferrable<Char, Args...>) {
+      if (site.severity != Fatal && detail::DeferFormatting.load(std::memory_order_relaxed) &&
+          detail::TryDefer<Char>(m_modName, site.severity, site.file, site.linenum, &site, format, args...))
+        return;
+    }
+    _vreportSite(site, site.format,
+                 fmt::basic_format_args<fmt::buffer_context<Char>>(
+                     fmt::make_args_checked<Args...>(format, std::forward<Args>(args)...)));
+  }
+
+  /**
+   * @brief reportSite behind the call site's rate limiter
+   *
+   * Normally invoked through LOGVISOR_REPORT_LIMITED.
+   */
+  template <typename S, typename... Args, typename Char = fmt::char_t<S>>
+  LOGVISOR_ALWAYS_INLINE void reportSiteLimited(RateLimiter& limiter, const CallSite& site, const S& format,
+                                                Args&&... args) {
+    if (site.severity != Fatal &&
+        !limiter.admit(*this, site.severity, site.file, site.linenum, &site, detail::HashArgs(args...)))
+      return;
+    reportSite(site, format, std::forward<Args>(args)...);
+  }
+};
+
+namespace detail {
+
+/* Argument of SignalSafeReport, limited to what can be formatted without fmt */
+struct SignalSafeArg {
+  enum Type { Int, UInt, Pointer, String, Char } type;
+  union {
+    int64_t i;
+    uint64_t u;
+    struct {
+      const char* data;
+      size_t size;
+    } s;
+    char c;
+  };
 };
 
+template <typename T>
+SignalSafeArg MakeSignalSafeArg(const T& val) {
+  SignalSafeArg arg{};
+  if constexpr (std::is_same_v<T, bool>) {
+    arg.type = SignalSafeArg::String;
+    arg.s = {val ? "true" : "false", val ? size_t(4) : size_t(5)};
+  } else if constexpr (std::is_same_v<T, char>) {
+    arg.type = SignalSafeArg::Char;
+    arg.c = val;
+  } else if constexpr (std::is_enum_v<T>) {
+    return MakeSignalSafeArg(std::underlying_type_t<T>(val));
+  } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+    arg.type = SignalSafeArg::Int;
+    arg.i = int64_t(val);
+  } else if constexpr (std::is_integral_v<T>) {
+    arg.type = SignalSafeArg::UInt;
+    arg.u = uint64_t(val);
+  } else if constexpr (std::is_convertible_v<const T&, std::string_view> && !std::is_pointer_v<std::decay_t<T>>) {
+    const std::string_view str(val);
+    arg.type = SignalSafeArg::String;
+    arg.s = {str.data(), str.size()};
+  } else if constexpr (std::is_convertible_v<const T&, const char*>) {
+    const char* str = val;
+    arg.type = SignalSafeArg::String;
+    arg.s = {str, str ? std::strlen(str) : 0};
+  } else {
+    static_assert(std::is_pointer_v<T>, "SignalSafeReport only formats integers, characters, strings and pointers");
+    arg.type = SignalSafeArg::Pointer;
+    arg.u = uint64_t(reinterpret_cast<uintptr_t>(val));
+  }
+  return arg;
+}
+
+} // namespace detail
+
+void _SignalSafeReport(const char* modName, Level severity, const char* format, const detail::SignalSafeArg* args,
+                       size_t argCount);
+
+/**
+ * @brief Report from a signal handler or other context where locking and allocation are unsafe
+ * @param module Reporting module
+ * @param severity Level of log report severity
+ * @param format Format string; "{}" and "{:x}" (hexadecimal) are substituted, "{{" and "}}" escaped
+ *
+ * Bypasses MainLoggers, thresholds and the flight recorder: the line is assembled in a fixed stack
+ * buffer (truncated at 1 KiB) and written to stderr with write(2). Arguments are limited to
+ * integers, bool, char, strings and pointers. Does not abort, even for Fatal.
+ */
+template <typename... Args>
+void SignalSafeReport(const Module& module, Level severity, const char* format, const Args&... args) {
+  const detail::SignalSafeArg safeArgs[] = {detail::MakeSignalSafeArg(args)..., detail::SignalSafeArg{}};
+  _SignalSafeReport(module.name(), severity, format, safeArgs, sizeof...(Args));
+}
+
+/**
+ * @brief Lowest severity compiled into LOGVISOR_REPORT call sites (0 = Info, 1 = Warning, 2 = Error)
+ *
+ * Call sites below this level are discarded at compile time along with the evaluation of their
+ * arguments. Fatal call sites are never discarded.
+ */
+#ifndef LOGVISOR_MIN_LEVEL
+#define LOGVISOR_MIN_LEVEL 0
+#endif
+
+/**
+ * @brief Report through a call site descriptor emitted as a static constant
+ * @param mod Module with static storage duration
+ * @param level Severity, must be a constant expression
+ * @param fmtstr Format string literal, checked at compile time
+ *
+ * Events carry a pointer to the descriptor instead of their own copy of the source location.
+ * Arguments are only evaluated if the module has the level enabled or the flight recorder captures it.
+ */
+#define LOGVISOR_REPORT(mod, level, fmtstr, ...)                                                                    \
+  do {                                                                                                               \
+    if constexpr ((level) >= LOGVISOR_MIN_LEVEL || (level) == ::logvisor::Fatal) {                                  \
+      static constexpr ::logvisor::CallSite logvisorCallSite{&(mod), (level), __FILE__, __LINE__,                   \
+                                                             ::fmt::string_view(fmtstr, sizeof(fmtstr) - 1)};        \
+      if ((mod).enabled(level) || ::logvisor::detail::FlightRecording(level))                                       \
+        (mod).reportSite(logvisorCallSite, FMT_STRING(fmtstr), ##__VA_ARGS__);                                       \
+    }                                                                                                                \
+  } while (0)
+
+/**
+ * @brief LOGVISOR_REPORT with a RateLimiter of its own
+ * @param perSecond Sustained messages per second admitted from this call site
+ * @param burst Messages admitted back to back before perSecond applies
+ *
+ * Duplicate suppression and summaries use the RateLimit defaults. Arguments are evaluated before
+ * the limiter decides, but dropped messages are never formatted.
+ */
+#define LOGVISOR_REPORT_LIMITED(mod, level, perSecond, burst, fmtstr, ...)                                          \
+  do {                                                                                                               \
+    if constexpr ((level) >= LOGVISOR_MIN_LEVEL || (level) == ::logvisor::Fatal) {                                  \
+      static constexpr ::logvisor::CallSite logvisorCallSite{&(mod), (level), __FILE__, __LINE__,                   \
+                                                             ::fmt::string_view(fmtstr, sizeof(fmtstr) - 1)};        \
+      static ::logvisor::RateLimiter logvisorRateLimiter{::logvisor::RateLimit{(perSecond), (burst)}};               \
+      if ((mod).enabled(level) || ::logvisor::detail::FlightRecording(level))                                       \
+        (mod).reportSiteLimited(logvisorRateLimiter, logvisorCallSite, FMT_STRING(fmtstr), ##__VA_ARGS__);           \
+    }                                                                                                                \
+  } while (0)
+
+/**
+ * @brief LOGVISOR_REPORT that only reports calls picked by a Sampler
+ * @param sampler Sampler factory call, e.g. ::logvisor::Sampler::EveryNth(16)
+ *
+ * Arguments of calls that are not sampled are not evaluated.
+ */
+#define LOGVISOR_REPORT_SAMPLED(mod, level, sampler, fmtstr, ...)                                                   \
+  do {                                                                                                               \
+    if constexpr ((level) >= LOGVISOR_MIN_LEVEL || (level) == ::logvisor::Fatal) {                                  \
+      static ::logvisor::Sampler logvisorSampler = sampler;                                                          \
+      static constexpr ::logvisor::CallSite logvisorCallSite{&(mod),   (level),                                     \
+                                                             __FILE__, __LINE__,                                    \
+                                                             ::fmt::string_view(fmtstr, sizeof(fmtstr) - 1),         \
+                                                             &logvisorSampler};                                      \
+      if (((mod).enabled(level) || ::logvisor::detail::FlightRecording(level)) && logvisorSampler.sample())         \
+        (mod).reportSite(logvisorCallSite, FMT_STRING(fmtstr), ##__VA_ARGS__);                                       \
+    }                                                                                                                \
+  } while (0)
+
+#define LOGVISOR_INFO(mod, fmtstr, ...) LOGVISOR_REPORT(mod, ::logvisor::Info, fmtstr, ##__VA_ARGS__)
+#define LOGVISOR_WARNING(mod, fmtstr, ...) LOGVISOR_REPORT(mod, ::logvisor::Warning, fmtstr, ##__VA_ARGS__)
+#define LOGVISOR_ERROR(mod, fmtstr, ...) LOGVISOR_REPORT(mod, ::logvisor::Error, fmtstr, ##__VA_ARGS__)
+#define LOGVISOR_FATAL(mod, fmtstr, ...) LOGVISOR_REPORT(mod, ::logvisor::Fatal, fmtstr, ##__VA_ARGS__)
+
 #define FMT_CUSTOM_FORMATTER(tp, fmtstr, ...) \
 namespace fmt { \
 template <> \
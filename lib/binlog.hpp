@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+/*
+ * Binary log stream written by RegisterBinaryFileLogger and read by logvisor-decode.
+ *
+ * A file is a sequence of sessions, one per time the logger opened it:
+ *
+ *   session := SessionMagic varint(clockNum) varint(clockDen) record*
+ *   record  := Tag::String varint(id) varint(len) bytes
+ *            | Tag::Stack varint(stackId) varint(len) bytes
+ *            | Tag::Event flags|level:u8 svarint(tickDelta) varint(frameIndex) varint(formatId)
+ *                         varint(moduleId) varint(threadId) varint(fileId) [varint(line) if fileId]
+ *                         varint(argCount) arg* [f32(sampleRate) if EventFlags::SampleRate]
+ *                         [varint(stackId) if EventFlags::Stack]
+ *   arg     := ArgType::Int svarint | ArgType::UInt varint | ArgType::Bool u8 | ArgType::Char u8
+ *            | ArgType::Float f32 | ArgType::Double f64 | ArgType::String varint(len) bytes
+ *            | ArgType::Pointer varint
+ *
+ * String IDs start at 1 and are scoped to their session; ID 0 means "absent". Ticks are
+ * steady_clock counts since logvisor initialization, delta-encoded against the previous
+ * event; seconds = ticks * clockNum / clockDen. Fixed-size values are little-endian. The level
+ * byte carries EventFlags in its high bits for the optional fields that follow the arguments;
+ * streams without them are what earlier versions wrote. A stack is defined once per session, ahead
+ * of the first event referencing it, with its symbolized frames as text loggers print them.
+ */
+
+namespace logvisor::binlog {
+
+constexpr char SessionMagic[8] = {'L', 'V', 'B', 'L', 'O', 'G', '0', '1'};
+
+enum class Tag : uint8_t {
+  String = 1,
+  Event = 2,
+  Stack = 3,
+};
+
+/* High bits of an event's level byte */
+enum EventFlags : uint8_t {
+  SampleRate = 0x80, /* Event came from a sampled call site; the fraction reported follows */
+  Stack = 0x40,      /* Event carries a captured stack; its ID follows */
+};
+constexpr uint8_t LevelMask = 0x0f;
+
+enum class ArgType : uint8_t {
+  Int = 1,
+  UInt,
+  Bool,
+  Char,
+  Float,
+  Double,
+  String,
+  Pointer,
+};
+
+constexpr size_t MaxVarintSize = 10;
+
+inline uint8_t* PutVarint(uint8_t* out, uint64_t val) {
+  while (val >= 0x80) {
+    *out++ = uint8_t(val | 0x80);
+    val >>= 7;
+  }
+  *out++ = uint8_t(val);
+  return out;
+}
+
+inline bool GetVarint(const uint8_t*& cur, const uint8_t* end, uint64_t& val) {
+  val = 0;
+  for (unsigned shift = 0; cur != end && shift < 64; shift += 7) {
+    const uint8_t byte = *cur++;
+    val |= uint64_t(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+constexpr uint64_t ZigZag(int64_t val) { return (uint64_t(val) << 1) ^ uint64_t(val >> 63); }
+
+constexpr int64_t UnZigZag(uint64_t val) { return int64_t(val >> 1) ^ -int64_t(val & 1); }
+
+} // namespace logvisor::binlog
@@ -0,0 +1,199 @@
+#pragma once
+
+/*
+ * Minimal ELF symbol table reader for the in-process symbolizer.
+ *
+ * An Image maps an object file read-only and indexes the function symbols from .symtab, or
+ * .dynsym for stripped objects. Symbol names point into the mapping, so the index costs one
+ * small entry per function and lookups need no further I/O. Build IDs identify a stripped object
+ * and the unstripped file it was produced from, which lets logvisor-symbolize pair them offline.
+ */
+
+#if __has_include(<elf.h>) && __has_include(<sys/mman.h>)
+#define LOGVISOR_HAS_ELF 1
+
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace logvisor::elf {
+
+#if UINTPTR_MAX > 0xffffffffu
+using Ehdr = Elf64_Ehdr;
+using Shdr = Elf64_Shdr;
+using Sym = Elf64_Sym;
+constexpr unsigned char NativeClass = ELFCLASS64;
+constexpr unsigned char SymType(unsigned char info) { return ELF64_ST_TYPE(info); }
+#else
+using Ehdr = Elf32_Ehdr;
+using Shdr = Elf32_Shdr;
+using Sym = Elf32_Sym;
+constexpr unsigned char NativeClass = ELFCLASS32;
+constexpr unsigned char SymType(unsigned char info) { return ELF32_ST_TYPE(info); }
+#endif
+
+/* Elf32_Nhdr and Elf64_Nhdr share one layout */
+using Nhdr = Elf32_Nhdr;
+
+/* Largest build ID handled, in bytes; GNU ld emits 20 (sha1) by default */
+constexpr size_t MaxBuildIdSize = 32;
+
+/*
+ * Finds the NT_GNU_BUILD_ID note in a PT_NOTE segment or SHT_NOTE section.
+ * Returns its size and points id at its bytes, or returns 0.
+ */
+inline size_t FindBuildId(const uint8_t* notes, size_t size, const uint8_t*& id) {
+  constexpr auto Align = [](size_t val) { return (val + 3) & ~size_t(3); };
+  while (size >= sizeof(Nhdr)) {
+    Nhdr nhdr;
+    std::memcpy(&nhdr, notes, sizeof(nhdr));
+    const size_t nameSize = Align(nhdr.n_namesz);
+    const size_t descSize = Align(nhdr.n_descsz);
+    if (nameSize > size - sizeof(Nhdr) || descSize > size - sizeof(Nhdr) - nameSize)
+      return 0;
+    const uint8_t* name = notes + sizeof(Nhdr);
+    if (nhdr.n_type == NT_GNU_BUILD_ID && nhdr.n_namesz == 4 && std::memcmp(name, "GNU", 4) == 0) {
+      id = name + nameSize;
+      return std::min(size_t(nhdr.n_descsz), MaxBuildIdSize);
+    }
+    notes += sizeof(Nhdr) + nameSize + descSize;
+    size -= sizeof(Nhdr) + nameSize + descSize;
+  }
+  return 0;
+}
+
+/* Writes a build ID as lowercase hex plus a terminator; out must hold 2 * size + 1 chars */
+inline void FormatBuildId(const uint8_t* id, size_t size, char* out) {
+  for (size_t i = 0; i < size; ++i) {
+    *out++ = "0123456789abcdef"[id[i] >> 4];
+    *out++ = "0123456789abcdef"[id[i] & 0xf];
+  }
+  *out = '\0';
+}
+
+class Image {
+  struct Symbol {
+    uint64_t addr;
+    uint64_t size;
+    const char* name;
+    bool operator<(const Symbol& other) const { return addr < other.addr; }
+  };
+
+  const uint8_t* m_data = nullptr;
+  size_t m_size = 0;
+  std::vector<Symbol> m_symbols;
+  std::string m_buildId;
+
+  template <typename T>
+  const T* at(uint64_t offset, uint64_t count = 1) const {
+    if (offset > m_size || count > (m_size - offset) / sizeof(T))
+      return nullptr;
+    return reinterpret_cast<const T*>(m_data + offset);
+  }
+
+  void indexSymbols(const Shdr* sections, unsigned sectionCount, uint32_t type) {
+    for (unsigned i = 0; i < sectionCount; ++i) {
+      const Shdr& symtab = sections[i];
+      if (symtab.sh_type != type || symtab.sh_entsize != sizeof(Sym) || symtab.sh_link >= sectionCount)
+        continue;
+      const Shdr& strtab = sections[symtab.sh_link];
+      const Sym* syms = at<Sym>(symtab.sh_offset, symtab.sh_size / sizeof(Sym));
+      const char* strings = at<char>(strtab.sh_offset, strtab.sh_size);
+      if (!syms || !strings || strtab.sh_size == 0 || strings[strtab.sh_size - 1] != '\0')
+        continue;
+      for (size_t s = 0; s < symtab.sh_size / sizeof(Sym); ++s) {
+        const Sym& sym = syms[s];
+        const unsigned char symType = SymType(sym.st_info);
+        if ((symType != STT_FUNC && symType != STT_GNU_IFUNC) || sym.st_shndx == SHN_UNDEF || sym.st_value == 0 ||
+            sym.st_name >= strtab.sh_size)
+          continue;
+        m_symbols.push_back({sym.st_value, sym.st_size, strings + sym.st_name});
+      }
+    }
+  }
+
+public:
+  explicit Image(const char* path) {
+    const int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+      return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size >= off_t(sizeof(Ehdr))) {
+      void* map = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map != MAP_FAILED) {
+        m_data = static_cast<const uint8_t*>(map);
+        m_size = size_t(st.st_size);
+      }
+    }
+    close(fd);
+    if (!m_data)
+      return;
+
+    const Ehdr* ehdr = at<Ehdr>(0);
+    if (std::memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 || ehdr->e_ident[EI_CLASS] != NativeClass ||
+        ehdr->e_shentsize != sizeof(Shdr))
+      return;
+    const Shdr* sections = at<Shdr>(ehdr->e_shoff, ehdr->e_shnum);
+    if (!sections)
+      return;
+
+    for (unsigned i = 0; i < ehdr->e_shnum && m_buildId.empty(); ++i) {
+      const uint8_t* notes = sections[i].sh_type == SHT_NOTE ? at<uint8_t>(sections[i].sh_offset, sections[i].sh_size)
+                                                              : nullptr;
+      const uint8_t* id;
+      if (const size_t idSize = notes ? FindBuildId(notes, sections[i].sh_size, id) : 0) {
+        char hex[2 * MaxBuildIdSize + 1];
+        FormatBuildId(id, idSize, hex);
+        m_buildId = hex;
+      }
+    }
+
+    indexSymbols(sections, ehdr->e_shnum, SHT_SYMTAB);
+    if (m_symbols.empty())
+      indexSymbols(sections, ehdr->e_shnum, SHT_DYNSYM);
+    std::sort(m_symbols.begin(), m_symbols.end());
+    /* Aliases share an address; keep the first name that has a size */
+    m_symbols.erase(std::unique(m_symbols.begin(), m_symbols.end(),
+                                [](const Symbol& a, const Symbol& b) { return a.addr == b.addr && a.size; }),
+                    m_symbols.end());
+  }
+
+  ~Image() {
+    if (m_data)
+      munmap(const_cast<uint8_t*>(m_data), m_size);
+  }
+  Image(const Image&) = delete;
+  Image& operator=(const Image&) = delete;
+
+  bool hasSymbols() const { return !m_symbols.empty(); }
+
+  /* Lowercase hex of the GNU build ID, empty if the object has none */
+  const std::string& buildId() const { return m_buildId; }
+
+  /**
+   * Finds the function containing a link-time virtual address.
+   * Returns its name and sets offset to addr's distance from its start, or returns nullptr.
+   */
+  const char* lookup(uint64_t addr, uint64_t& offset) const {
+    auto it = std::upper_bound(m_symbols.begin(), m_symbols.end(), Symbol{addr, 0, nullptr});
+    if (it == m_symbols.begin())
+      return nullptr;
+    --it;
+    if (it->size && addr >= it->addr + it->size)
+      return nullptr;
+    offset = addr - it->addr;
+    return it->name;
+  }
+};
+
+} // namespace logvisor::elf
+
+#endif
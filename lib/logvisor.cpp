@@ -18,28 +18,54 @@
 #include <dlfcn.h>
 #include <cxxabi.h>
 #include <cstring>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#if __has_include(<unwind.h>)
+#include <unwind.h>
+#endif
+#include <pthread.h>
 #if __linux__
+#include <link.h>
 #include <sys/prctl.h>
+#include <sys/syscall.h>
 #endif
 #endif
 
 #include <fcntl.h>
+#include <algorithm>
+#include <bit>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
 #include <mutex>
 #include <thread>
 #include <string>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <cstdio>
+#include <cctype>
+#include <cerrno>
+#include <climits>
 #include <cinttypes>
 #include <csignal>
 #include <locale>
 #include <optional>
 #include "logvisor/logvisor.hpp"
+#include "binlog.hpp"
+#include "elfsym.hpp"
+#include "uring.hpp"
 
 #if SENTRY_ENABLED
 #include <sentry.h>
 #endif
 
+#if LOGVISOR_HAS_ZLIB
+#include <zlib.h>
+#endif
+
 /* ANSI sequences */
 #define RED "\x1b[1;31m"
 #define YELLOW "\x1b[1;33m"
@@ -62,15 +88,192 @@ void logvisorBp() {}
 namespace logvisor {
 static Module Log("logvisor");
 
-static std::unordered_map<std::thread::id, const char*> ThreadMap;
+/* Name of the calling thread as given to RegisterThreadName; this is all the report path reads */
+static thread_local const char* CurrentThreadName = nullptr;
 
-static void AddThreadToMap(const char* name) {
-  auto lk = LockLog();
-  ThreadMap[std::this_thread::get_id()] = name;
+/*
+ * Every thread that ever registered a name, kept only for GetThreadNames.
+ * Entries are pushed with a CAS and never removed, so readers can walk the list without locking.
+ */
+struct ThreadNameEntry {
+  std::thread::id thrId;
+  std::atomic<const char*> name;
+  ThreadNameEntry* next;
+};
+static std::atomic<ThreadNameEntry*> ThreadNameList{nullptr};
+static thread_local ThreadNameEntry* CurrentThreadEntry = nullptr;
+
+static void AddThreadName(const char* name) {
+  CurrentThreadName = name;
+  if (CurrentThreadEntry) {
+    CurrentThreadEntry->name.store(name, std::memory_order_release);
+    return;
+  }
+  auto* entry = new ThreadNameEntry{std::this_thread::get_id(), {name}, ThreadNameList.load(std::memory_order_relaxed)};
+  while (!ThreadNameList.compare_exchange_weak(entry->next, entry, std::memory_order_release,
+                                               std::memory_order_relaxed)) {
+  }
+  CurrentThreadEntry = entry;
+}
+
+/* Level spec trie plus the list of modules that cached a threshold from it */
+struct ModuleRegistry {
+  struct LevelNode {
+    int threshold = -1;
+    std::unordered_map<std::string, std::unique_ptr<LevelNode>> children;
+  };
+
+  std::mutex mutex;
+  LevelNode root;
+  bool specLoaded = false;
+  const Module* head = nullptr;
+
+  /* Intentionally leaked so static Modules can unlink during shutdown */
+  static ModuleRegistry& Instance() {
+    static ModuleRegistry* registry = new ModuleRegistry;
+    return *registry;
+  }
+
+  static int ParseLevel(std::string_view str) {
+    std::string lower;
+    for (char ch : str)
+      lower += char(std::tolower(static_cast<unsigned char>(ch)));
+    if (lower == "info" || lower == "0")
+      return Info;
+    if (lower == "warn" || lower == "warning" || lower == "1")
+      return Warning;
+    if (lower == "error" || lower == "2")
+      return Error;
+    if (lower == "fatal" || lower == "off" || lower == "3")
+      return Fatal;
+    return -1;
+  }
+
+  static std::string_view Trim(std::string_view str) {
+    while (!str.empty() && std::isspace(static_cast<unsigned char>(str.front())))
+      str.remove_prefix(1);
+    while (!str.empty() && std::isspace(static_cast<unsigned char>(str.back())))
+      str.remove_suffix(1);
+    return str;
+  }
+
+  void parse(std::string_view spec) {
+    while (!spec.empty()) {
+      const size_t comma = spec.find(',');
+      const std::string_view entry = spec.substr(0, comma);
+      spec = comma == std::string_view::npos ? std::string_view() : spec.substr(comma + 1);
+
+      const size_t eq = entry.find('=');
+      if (eq == std::string_view::npos)
+        continue;
+      const int threshold = ParseLevel(Trim(entry.substr(eq + 1)));
+      if (threshold < 0)
+        continue;
+
+      std::string_view name = Trim(entry.substr(0, eq));
+      if (name.size() >= 2 && name.substr(name.size() - 2) == ".*")
+        name.remove_suffix(2);
+      LevelNode* node = &root;
+      if (name != "*") {
+        while (!name.empty()) {
+          const size_t dot = name.find('.');
+          auto& child = node->children[std::string(name.substr(0, dot))];
+          if (!child)
+            child = std::make_unique<LevelNode>();
+          node = child.get();
+          name = dot == std::string_view::npos ? std::string_view() : name.substr(dot + 1);
+        }
+      }
+      node->threshold = threshold;
+    }
+  }
+
+  /* Most specific matching entry, falling back to the "*" default and then Info */
+  int lookup(std::string_view name) const {
+    const LevelNode* node = &root;
+    int threshold = root.threshold;
+    while (!name.empty()) {
+      const size_t dot = name.find('.');
+      auto search = node->children.find(std::string(name.substr(0, dot)));
+      if (search == node->children.end())
+        break;
+      node = search->second.get();
+      if (node->threshold >= 0)
+        threshold = node->threshold;
+      name = dot == std::string_view::npos ? std::string_view() : name.substr(dot + 1);
+    }
+    return threshold < 0 ? int(Info) : threshold;
+  }
+
+  void loadEnvironment() {
+    if (specLoaded)
+      return;
+    specLoaded = true;
+    if (const char* spec = std::getenv("LOGVISOR_LEVELS"))
+      parse(spec);
+  }
+
+  void link(const Module& mod) {
+    if (mod.m_registered)
+      return;
+    mod.m_registered = true;
+    mod.m_nextRegistered = head;
+    head = &mod;
+  }
+
+  void unlink(const Module& mod) {
+    for (const Module** it = &head; *it; it = &(*it)->m_nextRegistered) {
+      if (*it == &mod) {
+        *it = mod.m_nextRegistered;
+        break;
+      }
+    }
+    mod.m_registered = false;
+  }
+
+  void setSpec(const char* spec) {
+    std::lock_guard<std::mutex> lk(mutex);
+    specLoaded = true;
+    root = LevelNode();
+    parse(spec ? spec : "");
+    for (const Module* mod = head; mod; mod = mod->m_nextRegistered)
+      mod->m_threshold.store(-1, std::memory_order_relaxed);
+  }
+};
+
+int Module::_resolveThreshold() const {
+  auto& registry = ModuleRegistry::Instance();
+  std::lock_guard<std::mutex> lk(registry.mutex);
+  registry.loadEnvironment();
+  int threshold = m_threshold.load(std::memory_order_relaxed);
+  if (threshold < 0) {
+    threshold = registry.lookup(m_modName);
+    m_threshold.store(threshold, std::memory_order_relaxed);
+  }
+  registry.link(*this);
+  return threshold;
+}
+
+void Module::setLevel(Level threshold) {
+  auto& registry = ModuleRegistry::Instance();
+  std::lock_guard<std::mutex> lk(registry.mutex);
+  registry.loadEnvironment();
+  m_threshold.store(threshold, std::memory_order_relaxed);
+  registry.link(*this);
+}
+
+Module::~Module() {
+  if (!m_registered)
+    return;
+  auto& registry = ModuleRegistry::Instance();
+  std::lock_guard<std::mutex> lk(registry.mutex);
+  registry.unlink(*this);
 }
 
+void SetLogLevels(const char* spec) { ModuleRegistry::Instance().setSpec(spec); }
+
 void RegisterThreadName(const char* name) {
-  AddThreadToMap(name);
+  AddThreadName(name);
 #if __APPLE__
   pthread_setname_np(name);
 #elif __linux__
@@ -88,6 +291,105 @@ void RegisterThreadName(const char* name) {
 #endif
 }
 
+std::vector<std::pair<std::thread::id, const char*>> GetThreadNames() {
+  std::vector<std::pair<std::thread::id, const char*>> names;
+  for (ThreadNameEntry* entry = ThreadNameList.load(std::memory_order_acquire); entry; entry = entry->next)
+    names.emplace_back(entry->thrId, entry->name.load(std::memory_order_acquire));
+  return names;
+}
+
+#if _WIN32
+static int OpenAppendFd(const char* filepath) {
+  return _open(filepath, _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+}
+static int WriteFd(int fd, const char* data, size_t size) {
+  return _write(fd, data, unsigned(std::min(size, size_t(INT_MAX))));
+}
+static void CloseFd(int fd) { _close(fd); }
+static int FileFd(FILE* fp) { return _fileno(fp); }
+#else
+static int OpenAppendFd(const char* filepath) {
+  return open(filepath, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+}
+static ssize_t WriteFd(int fd, const char* data, size_t size) { return write(fd, data, size); }
+static void CloseFd(int fd) { close(fd); }
+static int FileFd(FILE* fp) { return fileno(fp); }
+#endif
+
+static void WriteAllFd(int fd, const char* data, size_t size) {
+  while (size) {
+    const auto written = WriteFd(fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue;
+      return;
+    }
+    data += written;
+    size -= size_t(written);
+  }
+}
+
+static inline void AppendString(fmt::memory_buffer& out, std::string_view str) {
+  out.append(str.data(), str.data() + str.size());
+}
+
+/* Appends to a fixed stack buffer, silently truncating; nothing here may lock or allocate */
+class SignalSafeLine {
+  char m_buf[1024];
+  size_t m_size = 0;
+
+public:
+  /* One byte is held back so a truncated line still ends in a newline */
+  void append(const char* str, size_t size) {
+    size = std::min(size, sizeof(m_buf) - 1 - m_size);
+    std::memcpy(m_buf + m_size, str, size);
+    m_size += size;
+  }
+  void append(const char* str) { append(str, std::strlen(str)); }
+  void append(char ch) { append(&ch, 1); }
+  void append(uint64_t val, unsigned base, unsigned minDigits = 1) {
+    char digits[24];
+    size_t count = 0;
+    do {
+      digits[sizeof(digits) - ++count] = "0123456789abcdef"[val % base];
+      val /= base;
+    } while (val || count < minDigits);
+    append(digits + sizeof(digits) - count, count);
+  }
+  void appendArg(const detail::SignalSafeArg& arg, bool hex) {
+    switch (arg.type) {
+    case detail::SignalSafeArg::Int:
+      if (arg.i < 0 && !hex) {
+        append('-');
+        append(~uint64_t(arg.i) + 1, 10);
+      } else {
+        append(uint64_t(arg.i), hex ? 16 : 10);
+      }
+      break;
+    case detail::SignalSafeArg::UInt:
+      append(arg.u, hex ? 16 : 10);
+      break;
+    case detail::SignalSafeArg::Pointer:
+      append("0x");
+      append(uint64_t(arg.u), 16);
+      break;
+    case detail::SignalSafeArg::String:
+      if (arg.s.data)
+        append(arg.s.data, arg.s.size);
+      else
+        append("(null)");
+      break;
+    case detail::SignalSafeArg::Char:
+      append(arg.c);
+      break;
+    }
+  }
+  void endLine() { m_buf[m_size++] = '\n'; }
+  const char* data() const { return m_buf; }
+  size_t size() const { return m_size; }
+  void write(int fd) const { WriteAllFd(fd, m_buf, m_size); }
+};
+
 #if _WIN32
 #pragma comment(lib, "Dbghelp.lib")
 
@@ -124,7 +426,41 @@ void KillProcessTree() {
   }
 }
 
+/* Appends "<prefix>function+0xoffset" for each return address */
+static void FormatBacktrace(void* const* frames, size_t count, std::string_view prefix, fmt::memory_buffer& out) {
+  auto it = std::back_inserter(out);
+#if !WINDOWS_STORE
+  /* DbgHelp is single-threaded */
+  static std::mutex SymMutex;
+  std::lock_guard<std::mutex> lk(SymMutex);
+  static const HANDLE Process = [] {
+    HANDLE process = GetCurrentProcess();
+    SymInitialize(process, nullptr, TRUE);
+    return process;
+  }();
+  alignas(SYMBOL_INFO) char symbolBuf[sizeof(SYMBOL_INFO) + 256];
+  auto* symbol = reinterpret_cast<SYMBOL_INFO*>(symbolBuf);
+  for (size_t i = 0; i < count; ++i) {
+    AppendString(out, prefix);
+    std::memset(symbol, 0, sizeof(SYMBOL_INFO));
+    symbol->MaxNameLen = 255;
+    symbol->SizeOfStruct = sizeof(SYMBOL_INFO);
+    DWORD64 displacement = 0;
+    if (SymFromAddr(Process, DWORD64(frames[i]), &displacement, symbol))
+      fmt::format_to(it, FMT_STRING("{}+0x{:x}\n"), symbol->Name, displacement);
+    else
+      fmt::format_to(it, FMT_STRING("0x{:x}\n"), uintptr_t(frames[i]));
+  }
+#else
+  for (size_t i = 0; i < count; ++i) {
+    AppendString(out, prefix);
+    fmt::format_to(it, FMT_STRING("0x{:x}\n"), uintptr_t(frames[i]));
+  }
+#endif
+}
+
 [[noreturn]] void logvisorAbort() {
+  DumpFlightRecorder();
 #if !WINDOWS_STORE
   unsigned int i;
   void* stack[100];
@@ -175,13 +511,30 @@ void KillProcessTree() {
 }
 
 #elif defined(__SWITCH__)
+static void FormatBacktrace(void* const* frames, size_t count, std::string_view prefix, fmt::memory_buffer& out) {
+  for (size_t i = 0; i < count; ++i) {
+    AppendString(out, prefix);
+    fmt::format_to(std::back_inserter(out), FMT_STRING("0x{:x}\n"), uintptr_t(frames[i]));
+  }
+}
+
 [[noreturn]] void logvisorAbort() {
+  DumpFlightRecorder();
   MainLoggers.clear();
+  detail::MainLoggerCount.store(0);
   nvExit();
   exit(1);
 }
 #elif defined(EMSCRIPTEN)
+static void FormatBacktrace(void* const* frames, size_t count, std::string_view prefix, fmt::memory_buffer& out) {
+  for (size_t i = 0; i < count; ++i) {
+    AppendString(out, prefix);
+    fmt::format_to(std::back_inserter(out), FMT_STRING("0x{:x}\n"), uintptr_t(frames[i]));
+  }
+}
+
 [[noreturn]] void logvisorAbort() {
+  DumpFlightRecorder();
   abort();
 }
 #else
@@ -189,10 +542,276 @@ void KillProcessTree() {
 void KillProcessTree() {}
 
 #include <execinfo.h>
+
+#if __linux__ && LOGVISOR_HAS_ELF
+/* Resolves code addresses against the symbol tables of the loaded objects, keeping parsed images for reuse */
+class Symbolizer {
+  struct Object {
+    std::string path;
+    std::string name;
+    uintptr_t base;
+    std::vector<std::pair<uintptr_t, uintptr_t>> segments;
+    std::unique_ptr<elf::Image> image;
+  };
+  std::mutex m_mutex;
+  std::vector<Object> m_objects;
+
+  static int addObject(dl_phdr_info* info, size_t, void* ctx) {
+    auto& objects = *static_cast<std::vector<Object>*>(ctx);
+    Object obj;
+    if (info->dlpi_name && info->dlpi_name[0]) {
+      obj.path = info->dlpi_name;
+    } else if (objects.empty()) {
+      /* The main executable comes first and has no name */
+      char exePath[1024];
+      const ssize_t len = readlink("/proc/self/exe", exePath, sizeof(exePath));
+      obj.path = "/proc/self/exe";
+      obj.name.assign(exePath, len > 0 ? size_t(len) : 0);
+    } else {
+      return 0;
+    }
+    if (obj.name.empty())
+      obj.name = obj.path;
+    const size_t slash = obj.name.rfind('/');
+    if (slash != std::string::npos)
+      obj.name.erase(0, slash + 1);
+    obj.base = info->dlpi_addr;
+    for (int i = 0; i < info->dlpi_phnum; ++i) {
+      const auto& phdr = info->dlpi_phdr[i];
+      if (phdr.p_type == PT_LOAD)
+        obj.segments.emplace_back(obj.base + phdr.p_vaddr, obj.base + phdr.p_vaddr + phdr.p_memsz);
+    }
+    objects.push_back(std::move(obj));
+    return 0;
+  }
+
+  /* Libraries may have been loaded or unloaded since the last call; images of unchanged ones are kept */
+  void refresh() {
+    std::vector<Object> objects;
+    dl_iterate_phdr(addObject, &objects);
+    for (auto& obj : objects) {
+      for (auto& old : m_objects) {
+        if (old.image && old.base == obj.base && old.path == obj.path) {
+          obj.image = std::move(old.image);
+          break;
+        }
+      }
+    }
+    m_objects = std::move(objects);
+  }
+
+  Object* find(uintptr_t addr) {
+    for (auto& obj : m_objects)
+      for (const auto& [begin, end] : obj.segments)
+        if (addr >= begin && addr < end)
+          return &obj;
+    return nullptr;
+  }
+
+public:
+  static Symbolizer& Instance() {
+    static Symbolizer* Inst = new Symbolizer;
+    return *Inst;
+  }
+
+  /* Appends "<prefix>function+0xoffset (object+0xoffset)" for each return address */
+  void format(void* const* frames, size_t count, std::string_view prefix, fmt::memory_buffer& out) {
+    std::lock_guard<std::mutex> lk(m_mutex);
+    refresh();
+    auto it = std::back_inserter(out);
+    for (size_t i = 0; i < count; ++i) {
+      AppendString(out, prefix);
+      const uintptr_t addr = uintptr_t(frames[i]);
+      Object* obj = find(addr);
+      if (!obj) {
+        fmt::format_to(it, FMT_STRING("0x{:x}\n"), addr);
+        continue;
+      }
+      if (!obj->image)
+        obj->image = std::make_unique<elf::Image>(obj->path.c_str());
+      const uint64_t rel = addr - obj->base;
+      uint64_t symOffset = 0;
+      /* Return addresses point after the call, which may already be the next function */
+      const char* symName = obj->image->lookup(rel - 1, symOffset);
+      if (!symName) {
+        fmt::format_to(it, FMT_STRING("?? ({}+0x{:x})\n"), obj->name, rel);
+        continue;
+      }
+      int status;
+      char* demangledName = abi::__cxa_demangle(symName, nullptr, nullptr, &status);
+      fmt::format_to(it, FMT_STRING("{}+0x{:x} ({}+0x{:x})\n"), demangledName ? demangledName : symName,
+                     symOffset + 1, obj->name, rel);
+      std::free(demangledName);
+    }
+  }
+
+  void print(void* const* frames, size_t count, FILE* out) {
+    fmt::memory_buffer buf;
+    format(frames, count, "- ", buf);
+    std::fwrite(buf.data(), 1, buf.size(), out);
+  }
+};
+
+/* Module table captured by EnableDeferredSymbolization, so the fatal path needs no discovery */
+struct ModuleRecord {
+  uintptr_t base;
+  uintptr_t begin;
+  uintptr_t end;
+  char buildId[2 * elf::MaxBuildIdSize + 1];
+  char path[512];
+};
+static ModuleRecord ModuleTable[256];
+static std::atomic_size_t ModuleCount;
+static std::atomic_bool DeferSymbolization;
+
+static int RecordModule(dl_phdr_info* info, size_t, void* ctx) {
+  size_t& count = *static_cast<size_t*>(ctx);
+  if (count == std::size(ModuleTable))
+    return 1;
+  ModuleRecord& mod = ModuleTable[count];
+  if (info->dlpi_name && info->dlpi_name[0]) {
+    std::snprintf(mod.path, sizeof(mod.path), "%s", info->dlpi_name);
+  } else if (count == 0) {
+    /* The main executable comes first and has no name */
+    const ssize_t len = readlink("/proc/self/exe", mod.path, sizeof(mod.path) - 1);
+    mod.path[len > 0 ? len : 0] = '\0';
+  } else {
+    return 0;
+  }
+  mod.base = info->dlpi_addr;
+  mod.begin = UINTPTR_MAX;
+  mod.end = 0;
+  mod.buildId[0] = '\0';
+  for (int i = 0; i < info->dlpi_phnum; ++i) {
+    const auto& phdr = info->dlpi_phdr[i];
+    if (phdr.p_type == PT_LOAD) {
+      mod.begin = std::min(mod.begin, uintptr_t(mod.base + phdr.p_vaddr));
+      mod.end = std::max(mod.end, uintptr_t(mod.base + phdr.p_vaddr + phdr.p_memsz));
+    } else if (phdr.p_type == PT_NOTE && !mod.buildId[0]) {
+      const uint8_t* id;
+      if (const size_t idSize =
+              elf::FindBuildId(reinterpret_cast<const uint8_t*>(mod.base + phdr.p_vaddr), phdr.p_memsz, id))
+        elf::FormatBuildId(id, idSize, mod.buildId);
+    }
+  }
+  if (mod.begin < mod.end)
+    ++count;
+  return 0;
+}
+
+void EnableDeferredSymbolization() {
+  static std::mutex CaptureMutex;
+  std::lock_guard<std::mutex> lk(CaptureMutex);
+  /* Hide the table from the fatal path while it is rewritten */
+  ModuleCount.store(0, std::memory_order_release);
+  size_t count = 0;
+  dl_iterate_phdr(RecordModule, &count);
+  ModuleCount.store(count, std::memory_order_release);
+  DeferSymbolization.store(true, std::memory_order_release);
+}
+
+/*
+ * Prints the frames as raw addresses together with the modules they fall in, for
+ * logvisor-symbolize to resolve. Async-signal-safe; returns false when not enabled.
+ */
+static bool PrintDeferredBacktrace(void* const* frames, size_t count) {
+  if (!DeferSymbolization.load(std::memory_order_acquire))
+    return false;
+  const size_t moduleCount = ModuleCount.load(std::memory_order_acquire);
+  int16_t frameModules[128];
+  bool usedModules[std::size(ModuleTable)] = {};
+  count = std::min(count, std::size(frameModules));
+  for (size_t i = 0; i < count; ++i) {
+    const uintptr_t addr = uintptr_t(frames[i]);
+    frameModules[i] = -1;
+    for (size_t m = 0; m < moduleCount; ++m) {
+      if (addr >= ModuleTable[m].begin && addr < ModuleTable[m].end) {
+        frameModules[i] = int16_t(m);
+        usedModules[m] = true;
+        break;
+      }
+    }
+  }
+
+  SignalSafeLine header;
+  header.append("Raw backtrace, resolve with logvisor-symbolize:\n");
+  header.write(2);
+  for (size_t m = 0; m < moduleCount; ++m) {
+    if (!usedModules[m])
+      continue;
+    const ModuleRecord& mod = ModuleTable[m];
+    SignalSafeLine line;
+    line.append("logvisor-module ");
+    line.append(m, 10);
+    line.append(" 0x");
+    line.append(mod.base, 16);
+    line.append(' ');
+    line.append(mod.buildId[0] ? mod.buildId : "-");
+    line.append(' ');
+    line.append(mod.path);
+    line.append('\n');
+    line.write(2);
+  }
+  for (size_t i = 0; i < count; ++i) {
+    SignalSafeLine line;
+    line.append("logvisor-frame ");
+    line.append(i, 10);
+    line.append(" 0x");
+    line.append(uintptr_t(frames[i]), 16);
+    line.append(' ');
+    if (frameModules[i] >= 0)
+      line.append(uint64_t(frameModules[i]), 10);
+    else
+      line.append('-');
+    line.append('\n');
+    line.write(2);
+  }
+  return true;
+}
+#endif
+
+#if __linux__ && LOGVISOR_HAS_ELF
+static void FormatBacktrace(void* const* frames, size_t count, std::string_view prefix, fmt::memory_buffer& out) {
+  Symbolizer::Instance().format(frames, count, prefix, out);
+}
+#else
+/* Appends "<prefix>function+0xoffset (object+0xoffset)" for each return address, as far as dladdr can tell */
+static void FormatBacktrace(void* const* frames, size_t count, std::string_view prefix, fmt::memory_buffer& out) {
+  auto it = std::back_inserter(out);
+  for (size_t i = 0; i < count; ++i) {
+    AppendString(out, prefix);
+    const uintptr_t addr = uintptr_t(frames[i]);
+    Dl_info info;
+    if (!dladdr(frames[i], &info) || !info.dli_fname) {
+      fmt::format_to(it, FMT_STRING("0x{:x}\n"), addr);
+      continue;
+    }
+    const char* objName = std::strrchr(info.dli_fname, '/');
+    objName = objName ? objName + 1 : info.dli_fname;
+    const uintptr_t rel = addr - uintptr_t(info.dli_fbase);
+    if (!info.dli_sname) {
+      fmt::format_to(it, FMT_STRING("?? ({}+0x{:x})\n"), objName, rel);
+      continue;
+    }
+    int status;
+    char* demangledName = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+    fmt::format_to(it, FMT_STRING("{}+0x{:x} ({}+0x{:x})\n"), demangledName ? demangledName : info.dli_sname,
+                   addr - uintptr_t(info.dli_saddr), objName, rel);
+    std::free(demangledName);
+  }
+}
+#endif
+
 [[noreturn]] void logvisorAbort() {
+  DumpFlightRecorder();
   void* array[128];
   size_t size = backtrace(array, 128);
 
+#if __linux__ && LOGVISOR_HAS_ELF
+  std::fflush(stderr);
+  if (!PrintDeferredBacktrace(array, size))
+    Symbolizer::Instance().print(array, size, stderr);
+#else
   constexpr size_t exeBufSize = 1024 + 1;
   char exeNameBuffer[exeBufSize] = {};
 
@@ -240,6 +859,7 @@ void KillProcessTree() {}
       }
     }
   }
+#endif
 
   std::fflush(stderr);
   std::fflush(stdout);
@@ -255,590 +875,3450 @@ void KillProcessTree() {}
 
 #endif
 
-LogMutex _LogMutex;
+#if !__linux__ || !LOGVISOR_HAS_ELF
+void EnableDeferredSymbolization() {}
+#endif
 
-static void AbortHandler(int signum) {
-    _LogMutex.enabled = false;
-    switch (signum) {
-    case SIGSEGV:
-        Log.report(logvisor::Fatal, FMT_STRING("Segmentation Fault"));
-        break;
-    case SIGILL:
-        Log.report(logvisor::Fatal, FMT_STRING("Bad Execution"));
-        break;
-    case SIGFPE:
-        Log.report(logvisor::Fatal, FMT_STRING("Floating Point Exception"));
-        break;
-    case SIGABRT:
-        Log.report(logvisor::Fatal, FMT_STRING("Abort Signal"));
-        break;
-    default:
-        Log.report(logvisor::Fatal, FMT_STRING("unknown signal {}"), signum);
-        break;
-    }
-}
+LogMutex _LogMutex;
 
 uint64_t _LogCounter;
 
 std::vector<std::unique_ptr<ILogger>> MainLoggers;
+std::atomic_size_t detail::MainLoggerCount(0);
+
+/* Caller must hold the log lock */
+static void AddMainLogger(ILogger* logger) {
+  MainLoggers.emplace_back(logger);
+  detail::MainLoggerCount.store(MainLoggers.size(), std::memory_order_release);
+}
+
+void RegisterLogger(std::unique_ptr<ILogger> logger) {
+  auto lk = LockLog();
+  AddMainLogger(logger.release());
+}
+
 std::atomic_size_t ErrorCount(0);
 using MonoClock = std::chrono::steady_clock;
 static MonoClock::time_point GlobalStart = MonoClock::now();
 static inline MonoClock::duration CurrentUptime() { return MonoClock::now() - GlobalStart; }
 std::atomic_uint_fast64_t FrameIndex(0);
 
-static inline int ConsoleWidth() {
-  int retval = 80;
-#if _WIN32
-#if !WINDOWS_STORE
-  CONSOLE_SCREEN_BUFFER_INFO info;
-  GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info);
-  retval = info.dwSize.X - 1;
-#endif
-#elif defined(__SWITCH__)
-  return 80;
-#else
-  struct winsize w;
-  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) != -1)
-    retval = w.ws_col;
-#endif
-  if (retval < 10)
-    return 10;
-  return retval;
+/*
+ * Statistics for GetStats. Everything except the discard counter is written only by the thread
+ * delivering a record, which holds the log lock, so updates are plain relaxed loads and stores
+ * and readers need no lock.
+ */
+template <typename T>
+static inline void BumpCounter(std::atomic<T>& counter, T amount) {
+  counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
 }
 
-#if LOGVISOR_NX_LM
+static inline uint64_t Nanoseconds(MonoClock::duration duration) {
+  return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count());
+}
 
-struct ConsoleLogger : public ILogger {
-  Service m_svc{};
-  Service m_logger{};
-  bool m_ready = false;
+class AtomicHistogram {
+  std::atomic_uint64_t m_counts[LatencyHistogram::BucketCount]{};
+  std::atomic_uint64_t m_totalNs{0};
+  std::atomic_uint64_t m_maxNs{0};
 
-  struct MessageHeader {
-    enum Flags : u32 {
-      IsHead = 1,
-      IsTail = 2,
-    };
-    enum Severity : u32 {
-      Trace,
-      Info,
-      Warning,
-      Error,
-      Critical,
-    };
+  static unsigned BucketIndex(uint64_t ns) {
+    constexpr unsigned SubBucketBits = LatencyHistogram::SubBucketBits;
+    if (ns < LatencyHistogram::SubBuckets)
+      return unsigned(ns);
+    const unsigned shift = unsigned(std::bit_width(ns)) - 1 - SubBucketBits;
+    return ((shift + 1) << SubBucketBits) + unsigned(ns >> shift) - LatencyHistogram::SubBuckets;
+  }
 
-    u64 pid;
-    u64 thread_context;
-    //union {
-      //BitField<0, 16, Flags> flags;
-      //BitField<16, 8, Severity> severity;
-      //BitField<24, 8, u32> verbosity;
-    //};
-    u32 flags;
-    u32 payload_size;
+public:
+  void record(uint64_t ns) {
+    BumpCounter(m_counts[BucketIndex(ns)], uint64_t(1));
+    BumpCounter(m_totalNs, ns);
+    if (ns > m_maxNs.load(std::memory_order_relaxed))
+      m_maxNs.store(ns, std::memory_order_relaxed);
+  }
 
-    Flags GetFlags() const {
-      return Flags(flags & u32(0xffff));
-    }
-    void SetFlags(Flags f) {
-      flags &= ~u32(0xffff);
-      flags |= f;
-    }
-    Severity GetSeverity() const {
-      return Severity((flags >> u32(16)) & u32(0xff));
-    }
-    void SetSeverity(Severity f) {
-      flags &= ~u32(0xff0000);
-      flags |= f << u32(16);
-    }
-    u32 GetVerbosity() const {
-      return u32((flags >> u32(24)) & u32(0xff));
-    }
-    void SetVerbosity(u32 f) {
-      flags &= ~u32(0xff000000);
-      flags |= f << u32(24);
+  void snapshot(LatencyHistogram& out) const {
+    out.count = 0;
+    for (unsigned i = 0; i < LatencyHistogram::BucketCount; ++i) {
+      out.counts[i] = m_counts[i].load(std::memory_order_relaxed);
+      out.count += out.counts[i];
     }
+    out.totalNs = m_totalNs.load(std::memory_order_relaxed);
+    out.maxNs = m_maxNs.load(std::memory_order_relaxed);
+  }
+};
 
-    bool IsHeadLog() const {
-      return flags & IsHead;
-    }
-    bool IsTailLog() const {
-      return flags & IsTail;
-    }
-  };
-  static_assert(sizeof(MessageHeader) == 0x18, "MessageHeader is incorrect size");
+struct detail::SinkCounters {
+  AtomicHistogram latency;
+  std::atomic_uint64_t bytes{0};
+};
 
-  enum class Field : u8 {
-    Skip = 1,
-    Message = 2,
-    Line = 3,
-    Filename = 4,
-    Function = 5,
-    Module = 6,
-    Thread = 7,
-  };
+std::shared_ptr<detail::SinkCounters> detail::NewSinkCounters() { return std::make_shared<SinkCounters>(); }
 
-  static constexpr MessageHeader::Severity LevelToSeverity(Level l) {
-    switch (l) {
-    case Level::Info:
-    default:
-      return MessageHeader::Info;
-    case Level::Warning:
-      return MessageHeader::Warning;
-    case Level::Error:
-      return MessageHeader::Error;
-    case Level::Fatal:
-      return MessageHeader::Critical;
-    }
-  }
+detail::SinkCounters& detail::GetSinkCounters(ILogger& logger) { return *logger.m_sinkCounters; }
 
-  ConsoleLogger() {
-    if (R_SUCCEEDED(smGetService(&m_svc, "lm"))) {
-      auto pid = getpid();
-      if (R_SUCCEEDED(serviceDispatchIn(&m_svc, 0, pid, .out_num_objects = 1, .out_objects = &m_logger))) {
-        m_ready = true;
-        MessageHeader head{};
-        head.pid = getpid();
-        head.SetFlags(MessageHeader::IsHead);
-        serviceDispatch(&m_logger, 0,
-                        .buffer_attrs = { SfBufferAttr_HipcPointer | SfBufferAttr_In },
-                        .buffers = { { &head, sizeof(head) } });
-      }
-    }
-  }
+void ILogger::countBytes(size_t bytes) { BumpCounter(m_sinkCounters->bytes, uint64_t(bytes)); }
 
-  ~ConsoleLogger() override {
-    if (m_ready) {
-      MessageHeader head{};
-      head.pid = getpid();
-      head.SetFlags(MessageHeader::IsTail);
-      serviceDispatch(&m_logger, 0,
-                      .buffer_attrs = { SfBufferAttr_HipcPointer | SfBufferAttr_In },
-                      .buffers = { { &head, sizeof(head) } });
-    }
-    serviceClose(&m_logger);
-    serviceClose(&m_svc);
+/* Counter incremented from any thread, spread over cache lines so reporting threads rarely share one */
+class ShardedCounter {
+  static constexpr unsigned ShardCount = 16;
+  struct alignas(64) Shard {
+    std::atomic_uint64_t value{0};
+  };
+  Shard m_shards[ShardCount];
+
+  static unsigned ShardIndex() {
+    static std::atomic_uint NextShard{0};
+    static thread_local const unsigned Index = NextShard.fetch_add(1, std::memory_order_relaxed) % ShardCount;
+    return Index;
   }
 
-  void SendBuffer(const std::vector<u8>& buf) {
-    serviceDispatch(&m_logger, 0,
-                    .buffer_attrs = { SfBufferAttr_HipcPointer | SfBufferAttr_In },
-                    .buffers = { { buf.data(), buf.size() } });
+public:
+  void add(uint64_t amount) { m_shards[ShardIndex()].value.fetch_add(amount, std::memory_order_relaxed); }
+
+  uint64_t load() const {
+    uint64_t total = 0;
+    for (const Shard& shard : m_shards)
+      total += shard.value.load(std::memory_order_relaxed);
+    return total;
   }
+};
 
-  void report(const char* modName, Level severity, fmt::string_view format, fmt::format_args args) override {
-    if (!m_ready)
-      return;
+/* Records per module and Level, in an open-addressed table keyed by the module name pointer */
+class ModuleRecordTable {
+  static constexpr size_t Capacity = 1024;
+  struct Entry {
+    std::atomic<const char*> name{nullptr};
+    std::atomic_uint64_t records[4]{};
+  };
+  Entry m_entries[Capacity];
+  /* Modules beyond Capacity */
+  Entry m_overflow;
 
-    const std::thread::id thrId = std::this_thread::get_id();
-    const char* thrName = nullptr;
-    size_t thrNameSize = 0;
-    if (ThreadMap.find(thrId) != ThreadMap.end()) {
-      thrName = ThreadMap[thrId];
-      thrNameSize = std::min(std::strlen(thrName), size_t(255));
+public:
+  void count(const char* modName, Level severity) {
+    size_t index = size_t((uintptr_t(modName) * 0x9e3779b97f4a7c15) >> 54);
+    for (size_t probe = 0; probe < Capacity; ++probe, index = (index + 1) % Capacity) {
+      Entry& entry = m_entries[index];
+      const char* name = entry.name.load(std::memory_order_relaxed);
+      if (name == modName) {
+        BumpCounter(entry.records[severity], uint64_t(1));
+        return;
+      }
+      if (!name) {
+        BumpCounter(entry.records[severity], uint64_t(1));
+        entry.name.store(modName, std::memory_order_release);
+        return;
+      }
     }
+    BumpCounter(m_overflow.records[severity], uint64_t(1));
+  }
 
-    auto modNameSize = std::min(std::strlen(modName), size_t(255));
-    auto message = fmt::vformat(format, args);
-    auto messageSize = std::min(message.size(), size_t(255));
+  /* Modules with equal names but distinct name pointers are merged */
+  void collect(std::vector<ModuleStats>& out) const {
+    std::unordered_map<std::string_view, size_t> byName;
+    const auto add = [&](std::string_view name, const Entry& entry) {
+      auto it = byName.try_emplace(name, out.size()).first;
+      if (it->second == out.size())
+        out.push_back({std::string(name), {}});
+      for (int level = 0; level < 4; ++level)
+        out[it->second].records[level] += entry.records[level].load(std::memory_order_relaxed);
+    };
+    for (const Entry& entry : m_entries) {
+      if (const char* name = entry.name.load(std::memory_order_acquire))
+        add(name, entry);
+    }
+    if (m_overflow.records[0].load() || m_overflow.records[1].load() || m_overflow.records[2].load() ||
+        m_overflow.records[3].load())
+      add("(other)", m_overflow);
+    std::sort(out.begin(), out.end(), [](const ModuleStats& a, const ModuleStats& b) { return a.name < b.name; });
+  }
+};
 
-    std::vector<u8> bufOut(sizeof(MessageHeader) + (thrNameSize ? 2 + thrNameSize : 0) + 2 + modNameSize + 2 + messageSize, '\0');
+static std::atomic_uint64_t LevelRecords[4];
+static ModuleRecordTable ModuleRecords;
+static AtomicHistogram LockWaits;
+static ShardedCounter DiscardedRecords;
 
-    auto it = bufOut.begin();
+void detail::CountDiscarded() { DiscardedRecords.add(1); }
 
-    auto& head = *reinterpret_cast<MessageHeader*>(&*it);
-    head.pid = getpid();
-    head.payload_size = bufOut.size() - sizeof(MessageHeader);
-    head.SetSeverity(LevelToSeverity(severity));
-    it += sizeof(MessageHeader);
+/* LockLog for record delivery; a contended acquisition is timed into LockWaits once it succeeds */
+static std::unique_lock<std::recursive_mutex> LockLogForDelivery() {
+  if (!_LogMutex.enabled)
+    return {};
+  std::unique_lock<std::recursive_mutex> lk(_LogMutex.mutex, std::try_to_lock);
+  if (lk.owns_lock()) {
+    LockWaits.record(0);
+  } else {
+    const auto start = MonoClock::now();
+    lk.lock();
+    LockWaits.record(Nanoseconds(MonoClock::now() - start));
+  }
+  return lk;
+}
 
-    if (thrNameSize) {
-      *it++ = u8(Field::Thread);
-      *it++ = thrNameSize;
-      std::memcpy(&*it, thrName, thrNameSize);
-      it += thrNameSize;
-    }
+/* Hands a record to every logger, timing each one; the log lock must be held */
+static void DeliverRecord(const LogRecord& rec) {
+  if (MainLoggers.empty()) {
+    DiscardedRecords.add(1);
+    return;
+  }
+  BumpCounter(LevelRecords[rec.severity], uint64_t(1));
+  ModuleRecords.count(rec.modName, rec.severity);
+  auto start = MonoClock::now();
+  for (auto& logger : MainLoggers) {
+    logger->reportRecord(rec);
+    const auto end = MonoClock::now();
+    detail::GetSinkCounters(*logger).latency.record(Nanoseconds(end - start));
+    start = end;
+  }
+}
 
-    *it++ = u8(Field::Module);
-    *it++ = modNameSize;
-    std::memcpy(&*it, modName, modNameSize);
-    it += modNameSize;
+static void CollectQueueLosses(LogStats& stats);
 
-    *it++ = u8(Field::Message);
-    *it++ = messageSize;
-    std::memcpy(&*it, message.data(), messageSize);
-    it += messageSize;
+LogStats GetStats() {
+  LogStats stats;
+  for (int level = 0; level < 4; ++level)
+    stats.records[level] = LevelRecords[level].load(std::memory_order_relaxed);
+  ModuleRecords.collect(stats.modules);
+  LockWaits.snapshot(stats.lockWait);
+  stats.discarded = DiscardedRecords.load();
+  CollectQueueLosses(stats);
 
-    SendBuffer(bufOut);
+  auto lk = LockLog();
+  stats.sinks.reserve(MainLoggers.size());
+  for (auto& logger : MainLoggers) {
+    SinkStats& sink = stats.sinks.emplace_back();
+    sink.name = logger->sinkName();
+    sink.typeId = logger->getTypeId();
+    const detail::SinkCounters& counters = detail::GetSinkCounters(*logger);
+    sink.bytes = counters.bytes.load(std::memory_order_relaxed);
+    counters.latency.snapshot(sink.latency);
   }
+  return stats;
+}
 
-  void reportSource(const char* modName, Level severity, const char* file, unsigned linenum, fmt::string_view format,
-                    fmt::format_args args) override {
-    if (!m_ready)
-      return;
+#if _MSC_VER
+#define LOGVISOR_NOINLINE __declspec(noinline)
+#else
+#define LOGVISOR_NOINLINE __attribute__((noinline))
+#endif
 
-    const std::thread::id thrId = std::this_thread::get_id();
-    const char* thrName = nullptr;
-    size_t thrNameSize = 0;
-    if (ThreadMap.find(thrId) != ThreadMap.end()) {
-      thrName = ThreadMap[thrId];
-      thrNameSize = std::min(std::strlen(thrName), size_t(255));
-    }
+#if (defined(__x86_64__) || defined(__aarch64__)) && __linux__
+#define LOGVISOR_FRAME_POINTERS 1
 
-    auto modNameSize = std::min(std::strlen(modName), size_t(255));
-    auto fileNameSize = std::min(std::strlen(file), size_t(255));
-    auto message = fmt::vformat(format, args);
-    auto messageSize = std::min(message.size(), size_t(255));
+/* Bounds of the calling thread's stack, looked up once per thread; frame pointers outside are rejected */
+static bool CurrentStackBounds(uintptr_t& lo, uintptr_t& hi) {
+  static thread_local uintptr_t StackLo = 0;
+  static thread_local uintptr_t StackHi = 0;
+  if (!StackHi) {
+    pthread_attr_t attr;
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+      void* addr;
+      size_t size;
+      if (pthread_attr_getstack(&attr, &addr, &size) == 0) {
+        StackLo = uintptr_t(addr);
+        StackHi = StackLo + size;
+      }
+      pthread_attr_destroy(&attr);
+    }
+  }
+  lo = StackLo;
+  hi = StackHi;
+  return hi != 0;
+}
 
-    std::vector<u8> bufOut(sizeof(MessageHeader) + (thrNameSize ? 2 + thrNameSize : 0) + 2 + modNameSize + 2 + fileNameSize + 3 + 4 + 2 + messageSize, '\0');
+/*
+ * Sorted executable segments of the objects loaded when stack capture was enabled. A frame
+ * pointer walk that reaches code built without frame pointers reads arbitrary stack words;
+ * return addresses outside these ranges end it.
+ */
+using CodeRangeSet = std::vector<std::pair<uintptr_t, uintptr_t>>;
+static std::atomic<const CodeRangeSet*> CodeRanges{nullptr};
 
-    auto it = bufOut.begin();
+static void RefreshCodeRanges() {
+  auto ranges = std::make_unique<CodeRangeSet>();
+  dl_iterate_phdr(
+      [](dl_phdr_info* info, size_t, void* ctx) {
+        auto& set = *static_cast<CodeRangeSet*>(ctx);
+        for (int i = 0; i < info->dlpi_phnum; ++i) {
+          const auto& phdr = info->dlpi_phdr[i];
+          if (phdr.p_type == PT_LOAD && (phdr.p_flags & PF_X))
+            set.emplace_back(info->dlpi_addr + phdr.p_vaddr, info->dlpi_addr + phdr.p_vaddr + phdr.p_memsz);
+        }
+        return 0;
+      },
+      ranges.get());
+  std::sort(ranges->begin(), ranges->end());
+  /* Walkers may still be reading the previous set, so it is never freed */
+  CodeRanges.store(ranges.release(), std::memory_order_release);
+}
 
-    auto& head = *reinterpret_cast<MessageHeader*>(&*it);
-    head.pid = getpid();
-    head.payload_size = bufOut.size() - sizeof(MessageHeader);
-    head.SetSeverity(LevelToSeverity(severity));
-    it += sizeof(MessageHeader);
+static inline bool IsCodeAddress(const CodeRangeSet& ranges, uintptr_t addr) {
+  auto it = std::upper_bound(ranges.begin(), ranges.end(), std::make_pair(addr, UINTPTR_MAX));
+  return it != ranges.begin() && addr < std::prev(it)->second;
+}
 
-    if (thrNameSize) {
-      *it++ = u8(Field::Thread);
-      *it++ = thrNameSize;
-      std::memcpy(&*it, thrName, thrNameSize);
-      it += thrNameSize;
+/*
+ * Follows the saved frame pointer chain from the given frame. Stops at the first frame pointer
+ * that is misaligned, outside the stack or not above the previous one, or at the first return
+ * address outside known code; this is where code built without frame pointers breaks the chain.
+ * complete is set only if the walk filled frames or reached the null frame pointer that marks
+ * the outermost frame.
+ */
+static inline size_t WalkFramePointers(void* frame, void** frames, size_t maxFrames, size_t skip, bool& complete) {
+  complete = false;
+  uintptr_t lo, hi;
+  const CodeRangeSet* ranges = CodeRanges.load(std::memory_order_acquire);
+  if (!ranges || !CurrentStackBounds(lo, hi))
+    return 0;
+  size_t count = 0;
+  auto* fp = static_cast<const uintptr_t*>(frame);
+  while (count < maxFrames) {
+    const uintptr_t addr = uintptr_t(fp);
+    if (addr % sizeof(uintptr_t) || addr < lo || addr > hi - 2 * sizeof(uintptr_t))
+      return count;
+    const uintptr_t ret = fp[1];
+    if (!IsCodeAddress(*ranges, ret))
+      return count;
+    if (skip)
+      --skip;
+    else
+      frames[count++] = reinterpret_cast<void*>(ret);
+    const auto* next = reinterpret_cast<const uintptr_t*>(fp[0]);
+    if (!next) {
+      complete = true;
+      return count;
     }
+    if (next <= fp)
+      return count;
+    fp = next;
+  }
+  complete = true;
+  return count;
+}
+#endif
 
-    *it++ = u8(Field::Module);
-    *it++ = modNameSize;
-    std::memcpy(&*it, modName, modNameSize);
-    it += modNameSize;
+#if !_WIN32 && !defined(__SWITCH__) && !defined(EMSCRIPTEN) && __has_include(<unwind.h>)
+#define LOGVISOR_UNWIND_TABLES 1
 
-    *it++ = u8(Field::Filename);
-    *it++ = fileNameSize;
-    std::memcpy(&*it, file, fileNameSize);
-    it += fileNameSize;
+struct UnwindState {
+  void** frames;
+  size_t count;
+  size_t maxFrames;
+  size_t skip;
+};
 
-    *it++ = u8(Field::Line);
-    *it++ = 4;
-    *it++ = u8(Field::Skip);
-    std::memcpy(&*it, &linenum, 4);
-    it += 4;
+static _Unwind_Reason_Code UnwindFrame(_Unwind_Context* ctx, void* arg) {
+  auto& state = *static_cast<UnwindState*>(arg);
+  const uintptr_t ip = _Unwind_GetIP(ctx);
+  if (!ip)
+    return _URC_END_OF_STACK;
+  if (state.skip)
+    --state.skip;
+  else
+    state.frames[state.count++] = reinterpret_cast<void*>(ip);
+  return state.count == state.maxFrames ? _URC_END_OF_STACK : _URC_NO_REASON;
+}
+#endif
 
-    *it++ = u8(Field::Message);
-    *it++ = messageSize;
-    std::memcpy(&*it, message.data(), messageSize);
-    it += messageSize;
+static std::atomic_int StackCaptureLevel{Fatal + 1};
+static std::atomic_uint StackCaptureFrames{32};
+static std::atomic_bool StackCaptureFramePointers{false};
 
-    SendBuffer(bufOut);
+/*
+ * Return addresses of the caller's callers, innermost first, skipping skip frames past the
+ * caller. Frame pointers are tried first; a chain that breaks before the outermost frame (e.g.
+ * at a function built without them) is recaptured with the unwinder, which reads the unwind
+ * tables instead.
+ */
+static LOGVISOR_NOINLINE size_t CaptureStack(void** frames, size_t maxFrames, size_t skip) {
+  size_t count = 0;
+#if LOGVISOR_FRAME_POINTERS
+  if (StackCaptureFramePointers.load(std::memory_order_relaxed)) {
+    bool complete;
+    count = WalkFramePointers(__builtin_frame_address(0), frames, maxFrames, skip, complete);
+    if (complete)
+      return count;
   }
-};
-
-#else
-
-#if _WIN32
-static HANDLE Term = 0;
-#else
-static const char* Term = nullptr;
 #endif
-bool XtermColor = false;
-struct ConsoleLogger : public ILogger {
-  ConsoleLogger() : ILogger(log_typeid(ConsoleLogger)) {
-#if _WIN32
-#if !WINDOWS_STORE
-    const char* conemuANSI = getenv("ConEmuANSI");
-    if (conemuANSI && !strcmp(conemuANSI, "ON"))
-      XtermColor = true;
+#if LOGVISOR_UNWIND_TABLES
+  /* The unwinder also reports this function */
+  UnwindState state{frames, 0, maxFrames, skip + 1};
+  _Unwind_Backtrace(UnwindFrame, &state);
+  if (state.count)
+    count = state.count;
+#elif _WIN32
+  count = CaptureStackBackTrace(DWORD(skip + 1), DWORD(maxFrames), frames, nullptr);
 #endif
-    if (!Term)
-      Term = GetStdHandle(STD_ERROR_HANDLE);
-#else
-    if (!Term) {
-      Term = getenv("TERM");
-      if (Term && !strncmp(Term, "xterm", 5)) {
-        XtermColor = true;
-        putenv((char*)"TERM=xterm-16color");
-      }
-    }
+  return count;
+}
+
+#if LOGVISOR_FRAME_POINTERS
+/* Checks whether this build keeps frame pointers by walking two known frames */
+static LOGVISOR_NOINLINE bool ProbeFramePointersInner(void* outerReturn) {
+  void* frames[2];
+  bool complete;
+  return WalkFramePointers(__builtin_frame_address(0), frames, 2, 0, complete) == 2 &&
+         frames[0] == __builtin_return_address(0) && frames[1] == outerReturn;
+}
+
+static LOGVISOR_NOINLINE bool ProbeFramePointers() {
+  const bool result = ProbeFramePointersInner(__builtin_return_address(0));
+  /* Keep this frame from becoming a tail call */
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  return result;
+}
 #endif
-  }
-  ~ConsoleLogger() override = default;
 
-  static void _reportHead(const char* modName, const char* sourceInfo, Level severity) {
-    /* Clear current line out */
-    // std::fprintf(stderr, "\r%*c\r", ConsoleWidth(), ' ');
+/* Process-wide table of distinct stacks; IDs start at 1 and entries are never removed */
+class StackTable {
+  struct Entry {
+    /* Written once before the entry is published and never moved, so caches may point at it */
+    std::unique_ptr<void*[]> frames;
+    size_t count;
+    std::optional<std::string> rendered;
+  };
+  static constexpr size_t MaxStacks = 1 << 16;
+  /* Stacks this thread interned recently; repeats are compared against the entry's frames without the lock */
+  struct CacheSlot {
+    uint64_t hash;
+    uint32_t id;
+    const void* const* frames;
+    size_t count;
+  };
+  static thread_local CacheSlot RecentStacks[64];
+  std::mutex m_mutex;
+  std::unordered_map<uint64_t, uint32_t> m_index;
+  std::deque<Entry> m_entries;
 
-    const std::chrono::steady_clock::duration tm = CurrentUptime();
-    const double tmd = tm.count() * std::chrono::steady_clock::duration::period::num /
-                       static_cast<double>(std::chrono::steady_clock::duration::period::den);
-    const std::thread::id thrId = std::this_thread::get_id();
-    const char* thrName = nullptr;
-    if (ThreadMap.find(thrId) != ThreadMap.end())
-      thrName = ThreadMap[thrId];
+  static uint64_t hashFrames(void* const* frames, size_t count) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < count; ++i)
+      hash = (hash ^ uint64_t(uintptr_t(frames[i]))) * 0x100000001b3;
+    return hash ^ (hash >> 29);
+  }
 
-    if (XtermColor) {
-      std::fputs(BOLD "[", stderr);
-      fmt::print(stderr, FMT_STRING(GREEN "{:.4f} "), tmd);
-      const uint_fast64_t fIdx = FrameIndex.load();
-      if (fIdx != 0)
-        fmt::print(stderr, FMT_STRING("({}) "), fIdx);
-      switch (severity) {
-      case Info:
-        std::fputs(BOLD CYAN "INFO", stderr);
-        break;
-      case Warning:
-        std::fputs(BOLD YELLOW "WARNING", stderr);
-        break;
-      case Error:
-        std::fputs(RED BOLD "ERROR", stderr);
-        break;
-      case Fatal:
-        std::fputs(BOLD RED "FATAL ERROR", stderr);
-        break;
-      default:
-        break;
-      };
-      fmt::print(stderr, FMT_STRING(NORMAL BOLD " {}"), modName);
-      if (sourceInfo)
-        fmt::print(stderr, FMT_STRING(BOLD YELLOW " {{}}"), sourceInfo);
-      if (thrName)
-        fmt::print(stderr, FMT_STRING(BOLD MAGENTA " ({})"), thrName);
-      std::fputs(NORMAL BOLD "] " NORMAL, stderr);
-    } else {
-#if _WIN32
-#if !WINDOWS_STORE
-      SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_WHITE);
-      std::fputc('[', stderr);
-      SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_GREEN);
-      fmt::print(stderr, FMT_STRING("{:.4f} "), tmd);
-      const uint64_t fi = FrameIndex.load();
-      if (fi != 0)
-        std::fprintf(stderr, "(%" PRIu64 ") ", fi);
-      switch (severity) {
-      case Info:
-        SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_GREEN | FOREGROUND_BLUE);
-        std::fputs("INFO", stderr);
-        break;
-      case Warning:
-        SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_RED | FOREGROUND_GREEN);
-        std::fputs("WARNING", stderr);
-        break;
-      case Error:
-        SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_RED);
-        std::fputs("ERROR", stderr);
-        break;
-      case Fatal:
-        SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_RED);
-        std::fputs("FATAL ERROR", stderr);
-        break;
-      default:
-        break;
-      }
-      SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_WHITE);
-      fmt::print(stderr, FMT_STRING(" {}"), modName);
-      SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_RED | FOREGROUND_GREEN);
-      if (sourceInfo)
-        fmt::print(stderr, FMT_STRING(" {{}}"), sourceInfo);
-      SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_RED | FOREGROUND_BLUE);
-      if (thrName)
-        fmt::print(stderr, FMT_STRING(" ({})"), thrName);
-      SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_WHITE);
-      std::fputs("] ", stderr);
-      SetConsoleTextAttribute(Term, FOREGROUND_WHITE);
-#endif
-#else
-      std::fputc('[', stderr);
-      fmt::print(stderr, FMT_STRING("{:.4f} "), tmd);
-      uint_fast64_t fIdx = FrameIndex.load();
-      if (fIdx)
-        fmt::print(stderr, FMT_STRING("({}) "), fIdx);
-      switch (severity) {
-      case Info:
-        std::fputs("INFO", stderr);
-        break;
-      case Warning:
-        std::fputs("WARNING", stderr);
-        break;
-      case Error:
-        std::fputs("ERROR", stderr);
-        break;
-      case Fatal:
-        std::fputs("FATAL ERROR", stderr);
-        break;
-      default:
-        break;
+public:
+  /* Returns the stack's ID; 0 once the table is full */
+  uint32_t intern(void* const* frames, size_t count) {
+    const uint64_t hash = hashFrames(frames, count);
+    CacheSlot& recent = RecentStacks[hash % std::size(RecentStacks)];
+    if (recent.id && recent.hash == hash && recent.count == count &&
+        std::equal(frames, frames + count, recent.frames))
+      return recent.id;
+    std::lock_guard<std::mutex> lk(m_mutex);
+    auto it = m_index.find(hash);
+    if (it != m_index.end()) {
+      const Entry& entry = m_entries[it->second - 1];
+      if (entry.count == count && std::equal(frames, frames + count, entry.frames.get())) {
+        recent = {hash, it->second, entry.frames.get(), count};
+        return it->second;
       }
-      fmt::print(stderr, FMT_STRING(" {}"), modName);
-      if (sourceInfo)
-        fmt::print(stderr, FMT_STRING(" {{}}"), sourceInfo);
-      if (thrName)
-        fmt::print(stderr, FMT_STRING(" ({})"), thrName);
-      std::fputs("] ", stderr);
-#endif
     }
+    if (m_entries.size() == MaxStacks)
+      return 0;
+    Entry& entry = m_entries.emplace_back();
+    entry.frames.reset(new void*[count]);
+    std::copy(frames, frames + count, entry.frames.get());
+    entry.count = count;
+    const auto id = uint32_t(m_entries.size());
+    /* On a hash collision the newer stack stays unindexed and is never deduplicated */
+    if (m_index.emplace(hash, id).second)
+      recent = {hash, id, entry.frames.get(), count};
+    return id;
   }
 
-  void report(const char* modName, Level severity, fmt::string_view format, fmt::format_args args) override {
-    _reportHead(modName, nullptr, severity);
-    fmt::vprint(stderr, format, args);
-    std::fputc('\n', stderr);
-    std::fflush(stderr);
+  std::vector<void*> frames(uint32_t id) {
+    std::lock_guard<std::mutex> lk(m_mutex);
+    if (id == 0 || id > m_entries.size())
+      return {};
+    const Entry& entry = m_entries[id - 1];
+    return {entry.frames.get(), entry.frames.get() + entry.count};
   }
 
-  void reportSource(const char* modName, Level severity, const char* file, unsigned linenum, fmt::string_view format,
-                    fmt::format_args args) override {
-    _reportHead(modName, fmt::format(FMT_STRING("{}:{}"), file, linenum).c_str(), severity);
-    fmt::vprint(stderr, format, args);
-    std::fputc('\n', stderr);
-    std::fflush(stderr);
+  /* Symbolized frames, one indented line each; rendered on first use and kept */
+  const std::string& rendered(uint32_t id) {
+    static const std::string Empty;
+    std::lock_guard<std::mutex> lk(m_mutex);
+    if (id == 0 || id > m_entries.size())
+      return Empty;
+    Entry& entry = m_entries[id - 1];
+    if (!entry.rendered) {
+      fmt::memory_buffer buf;
+      FormatBacktrace(entry.frames.get(), entry.count, "    - ", buf);
+      entry.rendered.emplace(buf.data(), buf.size());
+    }
+    return *entry.rendered;
   }
 };
-#endif
+thread_local StackTable::CacheSlot StackTable::RecentStacks[64];
+static StackTable Stacks;
 
-static bool ConsoleLoggerRegistered = false;
+struct CapturedStack {
+  uint32_t id = 0;
+};
 
-void RegisterConsoleLogger() {
-  /* Otherwise construct new console logger */
-  if (!ConsoleLoggerRegistered) {
-    MainLoggers.emplace_back(new ConsoleLogger);
-    ConsoleLoggerRegistered = true;
-#if _WIN32
-#if 0
-    if (GetACP() != CP_UTF8) {
-      Log.report(Fatal, FMT_STRING("UTF-8 codepage not active! (Windows 10 1903+ required)"));
-    }
-#else
-    SetConsoleOutputCP(CP_UTF8);
-#endif
-#endif
-  }
+static LOGVISOR_NOINLINE CapturedStack InternReportStack() {
+  CapturedStack stack;
+  void* frames[128];
+  const size_t maxFrames = std::min(size_t(StackCaptureFrames.load(std::memory_order_relaxed)), std::size(frames));
+  /* Skip this function and _DispatchReport or DeferReport */
+  const size_t count = CaptureStack(frames, maxFrames, 2);
+  if (count)
+    stack.id = Stacks.intern(frames, count);
+  return stack;
 }
 
-#if _WIN32
-void CreateWin32Console() {
-#if !WINDOWS_STORE
-  /* Debug console */
-  AllocConsole();
+/* Captures and interns the reporting thread's stack if severity calls for one; the frames skipped by
+ * InternReportStack assume this is inlined into the entry point */
+static LOGVISOR_ALWAYS_INLINE CapturedStack CaptureReportStack(Level severity) {
+  if (severity < StackCaptureLevel.load(std::memory_order_relaxed))
+    return {};
+  return InternReportStack();
+}
 
-  std::freopen("CONIN$", "r", stdin);
-  std::freopen("CONOUT$", "w", stdout);
-  std::freopen("CONOUT$", "w", stderr);
+void EnableStackCapture(const StackCaptureOptions& options) {
+#if LOGVISOR_FRAME_POINTERS
+  RefreshCodeRanges();
+  StackCaptureFramePointers.store(options.framePointers && ProbeFramePointers());
 #endif
+  StackCaptureFrames.store(std::clamp(options.maxFrames, 1u, 128u));
+  StackCaptureLevel.store(options.level);
 }
-#endif
 
-void RegisterStandardExceptions() {
-  signal(SIGABRT, AbortHandler);
-  signal(SIGSEGV, AbortHandler);
-  signal(SIGILL, AbortHandler);
-  signal(SIGFPE, AbortHandler);
-}
+void DisableStackCapture() { StackCaptureLevel.store(Fatal + 1); }
 
-#if SENTRY_ENABLED
-void RegisterSentry(const char* appName, const char* appVersion, const char* cacheDir) {
-  sentry_options_t *options = sentry_options_new();
-  sentry_options_set_database_path(options, cacheDir);
-  sentry_options_set_auto_session_tracking(options, true);
-  sentry_options_set_symbolize_stacktraces(options, true);
-  sentry_options_set_dsn(options, SENTRY_DSN);
+std::vector<void*> GetStackFrames(uint32_t stackId) { return Stacks.frames(stackId); }
 
-#ifdef NDEBUG
-  sentry_options_set_environment(options, "release");
-#else
-  sentry_options_set_environment(options, "debug");
-#endif
+/* Stacks whose frames a text log already holds; sinks clear it whenever they start writing a new file */
+using PrintedStacks = std::unordered_set<uint32_t>;
 
-  std::string release = fmt::format(FMT_STRING("{}@{}"), appName, appVersion);
-  sentry_options_set_release(options, release.c_str());
+/* Appends " (stack N)" to a line, followed by the stack's frames on their own lines the first time this log sees it */
+static void AppendStackReference(fmt::memory_buffer& out, const LogRecord& rec, PrintedStacks& printed) {
+  if (!rec.stackId)
+    return;
+  fmt::format_to(std::back_inserter(out), FMT_STRING(" (stack {})"), rec.stackId);
+  if (printed.insert(rec.stackId).second) {
+    out.push_back('\n');
+    const std::string& frames = Stacks.rendered(rec.stackId);
+    AppendString(out, std::string_view(frames).substr(0, frames.empty() ? 0 : frames.size() - 1));
+  }
+}
 
-  sentry_init(options);
+/* Read on the reporting thread, right after the sampling decision */
+static inline float SampleRate(const CallSite* site) { return site && site->sampler ? site->sampler->rate() : 1.0f; }
+
+/* Appends " (sampled 1/N)" to a line for records from sampled call sites */
+static void AppendSampleRate(fmt::memory_buffer& out, const LogRecord& rec) {
+  if (rec.sampleRate < 1.0f)
+    fmt::format_to(std::back_inserter(out), FMT_STRING(" (sampled 1/{:g})"), 1.0f / rec.sampleRate);
 }
-#endif
 
-struct FileLogger : public ILogger {
-  FILE* fp = nullptr;
-  FileLogger(uint64_t typeHash) : ILogger(typeHash) {}
-  virtual void openFile() = 0;
-  void openFileIfNeeded() {
-    if (!fp) {
-      openFile();
-    }
+/* Strings are quoted when empty or when a space, quote, '=' or control character would make them ambiguous */
+static void AppendFieldString(fmt::memory_buffer& out, std::string_view str) {
+  const bool quoted = str.empty() || std::any_of(str.begin(), str.end(), [](char c) {
+                        return c == ' ' || c == '"' || c == '=' || static_cast<unsigned char>(c) < 0x20;
+                      });
+  if (!quoted) {
+    AppendString(out, str);
+    return;
   }
-  virtual void closeFile() {
-    if (fp) {
-      std::fflush(fp);
-      std::fclose(fp);
-      fp = nullptr;
+  out.push_back('"');
+  for (const char c : str) {
+    switch (c) {
+    case '"':
+      AppendString(out, "\\\"");
+      break;
+    case '\\':
+      AppendString(out, "\\\\");
+      break;
+    case '\n':
+      AppendString(out, "\\n");
+      break;
+    default:
+      if (static_cast<unsigned char>(c) < 0x20)
+        fmt::format_to(std::back_inserter(out), FMT_STRING("\\x{:02x}"), static_cast<unsigned char>(c));
+      else
+        out.push_back(c);
+      break;
     }
   }
-  virtual ~FileLogger() { closeFile(); }
-
-  void _reportHead(const char* modName, const char* sourceInfo, Level severity) {
-    const std::chrono::steady_clock::duration tm = CurrentUptime();
-    const double tmd = tm.count() * std::chrono::steady_clock::duration::period::num /
-                       static_cast<double>(std::chrono::steady_clock::duration::period::den);
-    const std::thread::id thrId = std::this_thread::get_id();
-    const char* thrName = nullptr;
-    if (ThreadMap.find(thrId) != ThreadMap.end()) {
-      thrName = ThreadMap[thrId];
-    }
+  out.push_back('"');
+}
 
-    std::fputc('[', fp);
-    std::fprintf(fp, "%5.4f ", tmd);
-    const uint_fast64_t fIdx = FrameIndex.load();
-    if (fIdx != 0) {
-      std::fprintf(fp, "(%" PRIu64 ") ", fIdx);
-    }
-    switch (severity) {
-    case Info:
-      std::fputs("INFO", fp);
+void detail::AppendFields(fmt::memory_buffer& out, const Field* fields, size_t count) {
+  for (size_t i = 0; i < count; ++i) {
+    const Field& field = fields[i];
+    out.push_back(' ');
+    AppendString(out, field.key);
+    out.push_back('=');
+    switch (field.type) {
+    case Field::Type::Int:
+      fmt::format_to(std::back_inserter(out), FMT_STRING("{}"), field.value.i);
       break;
-    case Warning:
-      std::fputs("WARNING", fp);
+    case Field::Type::UInt:
+      fmt::format_to(std::back_inserter(out), FMT_STRING("{}"), field.value.u);
       break;
-    case Error:
-      std::fputs("ERROR", fp);
+    case Field::Type::Float:
+      fmt::format_to(std::back_inserter(out), FMT_STRING("{}"), field.value.f);
       break;
-    case Fatal:
-      std::fputs("FATAL ERROR", fp);
+    case Field::Type::Bool:
+      AppendString(out, field.value.b ? "true" : "false");
       break;
-    default:
+    case Field::Type::String:
+      AppendFieldString(out, field.string());
       break;
-    };
-    std::fprintf(fp, " %s", modName);
-    if (sourceInfo) {
-      std::fprintf(fp, " {%s}", sourceInfo);
     }
-    if (thrName) {
-      std::fprintf(fp, " (%s)", thrName);
-    }
-    std::fputs("] ", fp);
   }
+}
+
+static LogRecord CaptureRecord(const char* modName, Level severity, const char* file, unsigned linenum,
+                               const CallSite* site, fmt::string_view format, fmt::format_args args,
+                               fmt::memory_buffer& messageBuffer, CapturedStack stack = {}) {
+  return {modName,         severity,          file,
+          linenum,         format,            args,
+          CurrentUptime(), FrameIndex.load(), CurrentThreadName,
+          site,            {},                &messageBuffer,
+          stack.id,        SampleRate(site)};
+}
+
+/* Per-thread storage for rendered messages; nested reports (from within a logger) fall back to their own */
+class MessageBuffer {
+  static thread_local fmt::memory_buffer SharedBuf;
+  static thread_local bool SharedInUse;
+  std::optional<fmt::memory_buffer> m_nestedBuf;
+  bool m_ownsShared = false;
+
+public:
+  MessageBuffer() {
+    if (SharedInUse)
+      m_nestedBuf.emplace();
+    else
+      SharedInUse = m_ownsShared = true;
+  }
+  ~MessageBuffer() {
+    if (m_ownsShared)
+      SharedInUse = false;
+  }
+  MessageBuffer(const MessageBuffer&) = delete;
+  MessageBuffer& operator=(const MessageBuffer&) = delete;
+  fmt::memory_buffer& get() { return m_ownsShared ? SharedBuf : *m_nestedBuf; }
+};
+thread_local fmt::memory_buffer MessageBuffer::SharedBuf;
+thread_local bool MessageBuffer::SharedInUse = false;
+
+/* Base for sinks that consume whole records; direct reports are captured here and passed to reportRecord */
+struct RecordLogger : public ILogger {
+  using ILogger::ILogger;
 
   void report(const char* modName, Level severity, fmt::string_view format, fmt::format_args args) override {
-    openFileIfNeeded();
-    _reportHead(modName, nullptr, severity);
-    fmt::vprint(fp, format, args);
-    std::fputc('\n', fp);
+    MessageBuffer buf;
+    reportRecord(CaptureRecord(modName, severity, nullptr, 0, nullptr, format, args, buf.get()));
   }
 
   void reportSource(const char* modName, Level severity, const char* file, unsigned linenum, fmt::string_view format,
                     fmt::format_args args) override {
-    openFileIfNeeded();
-    _reportHead(modName, fmt::format(FMT_STRING("{}:{}"), file, linenum).c_str(), severity);
-    fmt::vprint(fp, format, args);
-    std::fputc('\n', fp);
+    MessageBuffer buf;
+    reportRecord(CaptureRecord(modName, severity, file, linenum, nullptr, format, args, buf.get()));
   }
 };
 
-struct FileLogger8 : public FileLogger {
-  const char* m_filepath;
-  explicit FileLogger8(const char* filepath) : FileLogger(log_typeid(FileLogger8)), m_filepath(filepath) {}
-  void openFile() override { fp = std::fopen(m_filepath, "a"); }
-  ~FileLogger8() override = default;
+static inline double UptimeSeconds(MonoClock::duration tm) {
+  return tm.count() * MonoClock::duration::period::num / static_cast<double>(MonoClock::duration::period::den);
+}
+
+static constexpr const char* LevelName(Level severity) {
+  switch (severity) {
+  case Info:
+    return "INFO";
+  case Warning:
+    return "WARNING";
+  case Error:
+    return "ERROR";
+  case Fatal:
+    return "FATAL ERROR";
+  default:
+    return "";
+  }
+}
+
+static inline int ConsoleWidth() {
+  int retval = 80;
+#if _WIN32
+#if !WINDOWS_STORE
+  CONSOLE_SCREEN_BUFFER_INFO info;
+  GetConsoleScreenBufferInfo(GetStdHandle(STD_OUTPUT_HANDLE), &info);
+  retval = info.dwSize.X - 1;
+#endif
+#elif defined(__SWITCH__)
+  return 80;
+#else
+  struct winsize w;
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &w) != -1)
+    retval = w.ws_col;
+#endif
+  if (retval < 10)
+    return 10;
+  return retval;
+}
+
+/* Background thread for batching sinks, writing out data left in their buffer while nothing else is logged */
+class IdleFlusher {
+  std::thread m_thread;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  bool m_stopping = false;
+
+public:
+  ~IdleFlusher() { stop(); }
+
+  /* Calls flushIdle with the log lock held once per interval; a zero interval starts nothing */
+  template <typename Func>
+  void start(std::chrono::milliseconds interval, Func flushIdle) {
+    if (interval.count() <= 0)
+      return;
+    m_thread = std::thread([this, interval, flushIdle]() {
+      std::unique_lock<std::mutex> lk(m_mutex);
+      while (!m_stopping) {
+        m_cv.wait_for(lk, interval);
+        if (m_stopping)
+          break;
+        /* Never block on the log lock here; the sink's destructor may be holding it while stopping */
+        std::unique_lock<std::recursive_mutex> logLk(_LogMutex.mutex, std::try_to_lock);
+        if (logLk && _LogMutex.enabled)
+          flushIdle();
+      }
+    });
+  }
+
+  /* Sinks call this first in their destructor, before the state flushIdle touches goes away */
+  void stop() {
+    if (!m_thread.joinable())
+      return;
+    {
+      std::lock_guard<std::mutex> lk(m_mutex);
+      m_stopping = true;
+    }
+    m_cv.notify_one();
+    m_thread.join();
+  }
 };
 
-void RegisterFileLogger(const char* filepath) {
-  /* Otherwise construct new file logger */
-  MainLoggers.emplace_back(new FileLogger8(filepath));
+#if LOGVISOR_NX_LM
+
+struct ConsoleLogger : public RecordLogger {
+  Service m_svc{};
+  Service m_logger{};
+  bool m_ready = false;
+
+  struct MessageHeader {
+    enum Flags : u32 {
+      IsHead = 1,
+      IsTail = 2,
+    };
+    enum Severity : u32 {
+      Trace,
+      Info,
+      Warning,
+      Error,
+      Critical,
+    };
+
+    u64 pid;
+    u64 thread_context;
+    //union {
+      //BitField<0, 16, Flags> flags;
+      //BitField<16, 8, Severity> severity;
+      //BitField<24, 8, u32> verbosity;
+    //};
+    u32 flags;
+    u32 payload_size;
+
+    Flags GetFlags() const {
+      return Flags(flags & u32(0xffff));
+    }
+    void SetFlags(Flags f) {
+      flags &= ~u32(0xffff);
+      flags |= f;
+    }
+    Severity GetSeverity() const {
+      return Severity((flags >> u32(16)) & u32(0xff));
+    }
+    void SetSeverity(Severity f) {
+      flags &= ~u32(0xff0000);
+      flags |= f << u32(16);
+    }
+    u32 GetVerbosity() const {
+      return u32((flags >> u32(24)) & u32(0xff));
+    }
+    void SetVerbosity(u32 f) {
+      flags &= ~u32(0xff000000);
+      flags |= f << u32(24);
+    }
+
+    bool IsHeadLog() const {
+      return flags & IsHead;
+    }
+    bool IsTailLog() const {
+      return flags & IsTail;
+    }
+  };
+  static_assert(sizeof(MessageHeader) == 0x18, "MessageHeader is incorrect size");
+
+  enum class Field : u8 {
+    Skip = 1,
+    Message = 2,
+    Line = 3,
+    Filename = 4,
+    Function = 5,
+    Module = 6,
+    Thread = 7,
+  };
+
+  static constexpr MessageHeader::Severity LevelToSeverity(Level l) {
+    switch (l) {
+    case Level::Info:
+    default:
+      return MessageHeader::Info;
+    case Level::Warning:
+      return MessageHeader::Warning;
+    case Level::Error:
+      return MessageHeader::Error;
+    case Level::Fatal:
+      return MessageHeader::Critical;
+    }
+  }
+
+  /* lm receives whole messages, so there is nothing to batch */
+  explicit ConsoleLogger(const ConsoleOptions&) : ConsoleLogger() {}
+
+  ConsoleLogger() {
+    if (R_SUCCEEDED(smGetService(&m_svc, "lm"))) {
+      auto pid = getpid();
+      if (R_SUCCEEDED(serviceDispatchIn(&m_svc, 0, pid, .out_num_objects = 1, .out_objects = &m_logger))) {
+        m_ready = true;
+        MessageHeader head{};
+        head.pid = getpid();
+        head.SetFlags(MessageHeader::IsHead);
+        serviceDispatch(&m_logger, 0,
+                        .buffer_attrs = { SfBufferAttr_HipcPointer | SfBufferAttr_In },
+                        .buffers = { { &head, sizeof(head) } });
+      }
+    }
+  }
+
+  ~ConsoleLogger() override {
+    if (m_ready) {
+      MessageHeader head{};
+      head.pid = getpid();
+      head.SetFlags(MessageHeader::IsTail);
+      serviceDispatch(&m_logger, 0,
+                      .buffer_attrs = { SfBufferAttr_HipcPointer | SfBufferAttr_In },
+                      .buffers = { { &head, sizeof(head) } });
+    }
+    serviceClose(&m_logger);
+    serviceClose(&m_svc);
+  }
+
+  void SendBuffer(const std::vector<u8>& buf) {
+    serviceDispatch(&m_logger, 0,
+                    .buffer_attrs = { SfBufferAttr_HipcPointer | SfBufferAttr_In },
+                    .buffers = { { buf.data(), buf.size() } });
+  }
+
+  void _send(const LogRecord& rec) {
+    const char* thrName = rec.threadName;
+    const size_t thrNameSize = thrName ? std::min(std::strlen(thrName), size_t(255)) : 0;
+
+    auto modNameSize = std::min(std::strlen(rec.modName), size_t(255));
+    const auto message = rec.message();
+    auto messageSize = std::min(message.size(), size_t(255));
+
+    std::vector<u8> bufOut(sizeof(MessageHeader) + (thrNameSize ? 2 + thrNameSize : 0) + 2 + modNameSize + 2 + messageSize, '\0');
+
+    auto it = bufOut.begin();
+
+    auto& head = *reinterpret_cast<MessageHeader*>(&*it);
+    head.pid = getpid();
+    head.payload_size = bufOut.size() - sizeof(MessageHeader);
+    head.SetSeverity(LevelToSeverity(rec.severity));
+    it += sizeof(MessageHeader);
+
+    if (thrNameSize) {
+      *it++ = u8(Field::Thread);
+      *it++ = thrNameSize;
+      std::memcpy(&*it, thrName, thrNameSize);
+      it += thrNameSize;
+    }
+
+    *it++ = u8(Field::Module);
+    *it++ = modNameSize;
+    std::memcpy(&*it, rec.modName, modNameSize);
+    it += modNameSize;
+
+    *it++ = u8(Field::Message);
+    *it++ = messageSize;
+    std::memcpy(&*it, message.data(), messageSize);
+    it += messageSize;
+
+    SendBuffer(bufOut);
+  }
+
+  void _sendSource(const LogRecord& rec) {
+    const char* thrName = rec.threadName;
+    const size_t thrNameSize = thrName ? std::min(std::strlen(thrName), size_t(255)) : 0;
+
+    auto modNameSize = std::min(std::strlen(rec.modName), size_t(255));
+    auto fileNameSize = std::min(std::strlen(rec.file), size_t(255));
+    const auto message = rec.message();
+    auto messageSize = std::min(message.size(), size_t(255));
+
+    std::vector<u8> bufOut(sizeof(MessageHeader) + (thrNameSize ? 2 + thrNameSize : 0) + 2 + modNameSize + 2 + fileNameSize + 3 + 4 + 2 + messageSize, '\0');
+
+    auto it = bufOut.begin();
+
+    auto& head = *reinterpret_cast<MessageHeader*>(&*it);
+    head.pid = getpid();
+    head.payload_size = bufOut.size() - sizeof(MessageHeader);
+    head.SetSeverity(LevelToSeverity(rec.severity));
+    it += sizeof(MessageHeader);
+
+    if (thrNameSize) {
+      *it++ = u8(Field::Thread);
+      *it++ = thrNameSize;
+      std::memcpy(&*it, thrName, thrNameSize);
+      it += thrNameSize;
+    }
+
+    *it++ = u8(Field::Module);
+    *it++ = modNameSize;
+    std::memcpy(&*it, rec.modName, modNameSize);
+    it += modNameSize;
+
+    *it++ = u8(Field::Filename);
+    *it++ = fileNameSize;
+    std::memcpy(&*it, rec.file, fileNameSize);
+    it += fileNameSize;
+
+    *it++ = u8(Field::Line);
+    *it++ = 4;
+    *it++ = u8(Field::Skip);
+    std::memcpy(&*it, &rec.linenum, 4);
+    it += 4;
+
+    *it++ = u8(Field::Message);
+    *it++ = messageSize;
+    std::memcpy(&*it, message.data(), messageSize);
+    it += messageSize;
+
+    SendBuffer(bufOut);
+  }
+
+  void reportRecord(const LogRecord& rec) override {
+    if (!m_ready)
+      return;
+    if (rec.file)
+      _sendSource(rec);
+    else
+      _send(rec);
+  }
+
+  const char* sinkName() const override { return "console"; }
+};
+
+#else
+
+#if _WIN32
+static HANDLE Term = 0;
+#else
+static const char* Term = nullptr;
+#endif
+bool XtermColor = false;
+struct ConsoleLogger : public RecordLogger {
+  ConsoleOptions m_options;
+  /* Colors are only emitted to a terminal, never into pipes or files */
+  bool m_tty;
+  PrintedStacks m_printedStacks;
+
+  /* Batched mode */
+  std::unique_ptr<char[]> m_buf;
+  size_t m_size = 0;
+  MonoClock::time_point m_firstBuffered;
+  IdleFlusher m_flusher;
+
+  explicit ConsoleLogger(const ConsoleOptions& options) : RecordLogger(log_typeid(ConsoleLogger)), m_options(options) {
+#if _WIN32
+    m_tty = _isatty(_fileno(stderr));
+#if !WINDOWS_STORE
+    const char* conemuANSI = getenv("ConEmuANSI");
+    if (conemuANSI && !strcmp(conemuANSI, "ON") && m_tty)
+      XtermColor = true;
+#endif
+    if (!Term)
+      Term = GetStdHandle(STD_ERROR_HANDLE);
+#else
+    m_tty = isatty(STDERR_FILENO);
+    if (!Term) {
+      Term = getenv("TERM");
+      if (Term && !strncmp(Term, "xterm", 5) && m_tty) {
+        XtermColor = true;
+        putenv((char*)"TERM=xterm-16color");
+      }
+    }
+#endif
+    if (m_options.batched) {
+      if (m_options.bufferSize == 0)
+        m_options.bufferSize = 1;
+      m_buf.reset(new char[m_options.bufferSize]);
+      m_flusher.start(m_options.flushInterval, [this]() {
+        if (m_size != 0 && MonoClock::now() - m_firstBuffered >= m_options.flushInterval)
+          flush();
+      });
+    }
+  }
+
+  ~ConsoleLogger() override {
+    m_flusher.stop();
+    flush();
+  }
+
+  /* Caller must hold the log lock */
+  void flush() {
+    if (m_size == 0)
+      return;
+    /* stderr is unbuffered, so this is a single write */
+    std::fwrite(m_buf.get(), 1, m_size, stderr);
+    std::fflush(stderr);
+    m_size = 0;
+  }
+
+  void buffer(const fmt::memory_buffer& line, Level severity) {
+    if (m_size + line.size() > m_options.bufferSize)
+      flush();
+    if (line.size() > m_options.bufferSize) {
+      std::fwrite(line.data(), 1, line.size(), stderr);
+      std::fflush(stderr);
+      return;
+    }
+    if (m_size == 0)
+      m_firstBuffered = MonoClock::now();
+    std::memcpy(m_buf.get() + m_size, line.data(), line.size());
+    m_size += line.size();
+    /* Fatal always reaches the terminal before logvisorAbort */
+    if (severity >= m_options.flushLevel || severity == Fatal ||
+        (m_options.flushInterval.count() > 0 && MonoClock::now() - m_firstBuffered >= m_options.flushInterval))
+      flush();
+  }
+
+  /* Assembles the complete line so it reaches stderr in a single write */
+  static void _formatLine(fmt::memory_buffer& out, const LogRecord& rec, PrintedStacks& printed) {
+    auto it = std::back_inserter(out);
+    const double tmd = UptimeSeconds(rec.uptime);
+
+    if (XtermColor) {
+      fmt::format_to(it, FMT_STRING(BOLD "[" GREEN "{:.4f} "), tmd);
+      if (rec.frameIndex != 0)
+        fmt::format_to(it, FMT_STRING("({}) "), rec.frameIndex);
+      switch (rec.severity) {
+      case Info:
+        AppendString(out, BOLD CYAN "INFO");
+        break;
+      case Warning:
+        AppendString(out, BOLD YELLOW "WARNING");
+        break;
+      case Error:
+        AppendString(out, RED BOLD "ERROR");
+        break;
+      case Fatal:
+        AppendString(out, BOLD RED "FATAL ERROR");
+        break;
+      default:
+        break;
+      };
+      fmt::format_to(it, FMT_STRING(NORMAL BOLD " {}"), rec.modName);
+      if (rec.file)
+        fmt::format_to(it, FMT_STRING(BOLD YELLOW " {{{}:{}}}"), rec.file, rec.linenum);
+      if (rec.threadName)
+        fmt::format_to(it, FMT_STRING(BOLD MAGENTA " ({})"), rec.threadName);
+      AppendString(out, NORMAL BOLD "] " NORMAL);
+    } else {
+      fmt::format_to(it, FMT_STRING("[{:.4f} "), tmd);
+      if (rec.frameIndex != 0)
+        fmt::format_to(it, FMT_STRING("({}) "), rec.frameIndex);
+      AppendString(out, LevelName(rec.severity));
+      fmt::format_to(it, FMT_STRING(" {}"), rec.modName);
+      if (rec.file)
+        fmt::format_to(it, FMT_STRING(" {{{}:{}}}"), rec.file, rec.linenum);
+      if (rec.threadName)
+        fmt::format_to(it, FMT_STRING(" ({})"), rec.threadName);
+      AppendString(out, "] ");
+    }
+
+    const fmt::string_view message = rec.message();
+    out.append(message.data(), message.data() + message.size());
+    detail::AppendFields(out, rec.fields, rec.fieldCount);
+    AppendSampleRate(out, rec);
+    AppendStackReference(out, rec, printed);
+    out.push_back('\n');
+  }
+
+#if _WIN32
+  /* Legacy console colors are attributes of the console, so the head is written piecewise */
+  static void _reportHeadAttributes(const LogRecord& rec) {
+#if !WINDOWS_STORE
+    const double tmd = UptimeSeconds(rec.uptime);
+    SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_WHITE);
+    std::fputc('[', stderr);
+    SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_GREEN);
+    fmt::print(stderr, FMT_STRING("{:.4f} "), tmd);
+    const uint64_t fi = rec.frameIndex;
+    if (fi != 0)
+      std::fprintf(stderr, "(%" PRIu64 ") ", fi);
+    switch (rec.severity) {
+    case Info:
+      SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_GREEN | FOREGROUND_BLUE);
+      break;
+    case Warning:
+      SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_RED | FOREGROUND_GREEN);
+      break;
+    case Error:
+    case Fatal:
+      SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_RED);
+      break;
+    default:
+      break;
+    }
+    std::fputs(LevelName(rec.severity), stderr);
+    SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_WHITE);
+    fmt::print(stderr, FMT_STRING(" {}"), rec.modName);
+    SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_RED | FOREGROUND_GREEN);
+    if (rec.file)
+      fmt::print(stderr, FMT_STRING(" {{{}:{}}}"), rec.file, rec.linenum);
+    SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_RED | FOREGROUND_BLUE);
+    if (rec.threadName)
+      fmt::print(stderr, FMT_STRING(" ({})"), rec.threadName);
+    SetConsoleTextAttribute(Term, FOREGROUND_INTENSITY | FOREGROUND_WHITE);
+    std::fputs("] ", stderr);
+    SetConsoleTextAttribute(Term, FOREGROUND_WHITE);
+#endif
+  }
+#endif
+
+  void reportRecord(const LogRecord& rec) override {
+#if _WIN32
+    if (!XtermColor && m_tty) {
+      flush();
+      _reportHeadAttributes(rec);
+      const fmt::string_view message = rec.message();
+      std::fwrite(message.data(), 1, message.size(), stderr);
+      if (rec.fieldCount) {
+        fmt::memory_buffer fields;
+        detail::AppendFields(fields, rec.fields, rec.fieldCount);
+        std::fwrite(fields.data(), 1, fields.size(), stderr);
+      }
+      std::fputc('\n', stderr);
+      std::fflush(stderr);
+      return;
+    }
+#endif
+    static thread_local fmt::memory_buffer LineBuf;
+    LineBuf.clear();
+    _formatLine(LineBuf, rec, m_printedStacks);
+    if (m_options.batched) {
+      buffer(LineBuf, rec.severity);
+    } else {
+      std::fwrite(LineBuf.data(), 1, LineBuf.size(), stderr);
+      std::fflush(stderr);
+    }
+    countBytes(LineBuf.size());
+  }
+
+  /* stderr is unbuffered, so only the batch is pending */
+  void reportSignalSafe(const char* line, size_t size) override {
+    WriteAllFd(2, m_buf.get(), m_size);
+    m_size = 0;
+    WriteAllFd(2, line, size);
+  }
+
+  const char* sinkName() const override { return "console"; }
+};
+#endif
+
+static bool ConsoleLoggerRegistered = false;
+
+void RegisterConsoleLogger() { RegisterConsoleLogger(ConsoleOptions()); }
+
+void RegisterConsoleLogger(const ConsoleOptions& options) {
+  /* Otherwise construct new console logger */
+  auto lk = LockLog();
+  if (!ConsoleLoggerRegistered) {
+    AddMainLogger(new ConsoleLogger(options));
+    ConsoleLoggerRegistered = true;
+#if _WIN32
+#if 0
+    if (GetACP() != CP_UTF8) {
+      Log.report(Fatal, FMT_STRING("UTF-8 codepage not active! (Windows 10 1903+ required)"));
+    }
+#else
+    SetConsoleOutputCP(CP_UTF8);
+#endif
+#endif
+  }
+}
+
+#if _WIN32
+void CreateWin32Console() {
+#if !WINDOWS_STORE
+  /* Debug console */
+  AllocConsole();
+
+  std::freopen("CONIN$", "r", stdin);
+  std::freopen("CONOUT$", "w", stdout);
+  std::freopen("CONOUT$", "w", stderr);
+#endif
+}
+#endif
+
+/* FileLogger's line head, assembled without fmt */
+static void AppendSignalSafeHead(SignalSafeLine& line, MonoClock::duration uptime, uint64_t frameIndex,
+                                 Level severity, const char* modName, const char* file, unsigned linenum,
+                                 const char* threadName) {
+  const uint64_t uptimeUs = uint64_t(std::chrono::duration_cast<std::chrono::microseconds>(uptime).count());
+  line.append('[');
+  line.append(uptimeUs / 1000000, 10);
+  line.append('.');
+  line.append(uptimeUs % 1000000 / 100, 10, 4);
+  line.append(' ');
+  if (frameIndex != 0) {
+    line.append('(');
+    line.append(frameIndex, 10);
+    line.append(") ");
+  }
+  line.append(LevelName(severity));
+  line.append(' ');
+  line.append(modName);
+  if (file) {
+    line.append(" {");
+    line.append(file);
+    line.append(':');
+    line.append(linenum, 10);
+    line.append('}');
+  }
+  if (threadName) {
+    line.append(" (");
+    line.append(threadName);
+    line.append(')');
+  }
+  line.append("] ");
+}
+
+static void FormatSignalSafeLine(SignalSafeLine& line, const char* modName, Level severity, const char* format,
+                                 const detail::SignalSafeArg* args, size_t argCount) {
+  AppendSignalSafeHead(line, CurrentUptime(), FrameIndex.load(std::memory_order_relaxed), severity, modName, nullptr,
+                       0, CurrentThreadName);
+
+  size_t nextArg = 0;
+  for (const char* cur = format; *cur; ++cur) {
+    if ((cur[0] == '{' && cur[1] == '{') || (cur[0] == '}' && cur[1] == '}')) {
+      line.append(*cur++);
+    } else if (cur[0] == '{' && cur[1] == '}') {
+      if (nextArg < argCount)
+        line.appendArg(args[nextArg++], false);
+      ++cur;
+    } else if (cur[0] == '{' && cur[1] == ':' && cur[2] == 'x' && cur[3] == '}') {
+      if (nextArg < argCount)
+        line.appendArg(args[nextArg++], true);
+      cur += 3;
+    } else {
+      line.append(*cur);
+    }
+  }
+  line.endLine();
+}
+
+void _SignalSafeReport(const char* modName, Level severity, const char* format, const detail::SignalSafeArg* args,
+                       size_t argCount) {
+  SignalSafeLine line;
+  FormatSignalSafeLine(line, modName, severity, format, args, argCount);
+  line.write(2);
+}
+
+static void DumpFlightRecorderSignalSafe();
+
+static void AbortHandler(int signum) {
+  const char* message;
+  switch (signum) {
+  case SIGSEGV:
+    message = "Segmentation Fault";
+    break;
+  case SIGILL:
+    message = "Bad Execution";
+    break;
+  case SIGFPE:
+    message = "Floating Point Exception";
+    break;
+  case SIGABRT:
+    message = "Abort Signal";
+    break;
+  default:
+    message = "unknown signal {}";
+    break;
+  }
+
+  const detail::SignalSafeArg arg = detail::MakeSignalSafeArg(signum);
+  SignalSafeLine line;
+  FormatSignalSafeLine(line, Log.name(), Fatal, message, &arg, 1);
+
+#if _WIN32 || defined(__SWITCH__) || defined(EMSCRIPTEN)
+  line.write(2);
+  _LogMutex.enabled = false;
+  logvisorAbort();
+#else
+  /* The faulting thread may hold the log lock, so loggers get the line through their signal-safe path */
+  if (!ConsoleLoggerRegistered)
+    line.write(2);
+  for (auto& logger : MainLoggers)
+    logger->reportSignalSafe(line.data(), line.size());
+  DumpFlightRecorderSignalSafe();
+  void* frames[128];
+  const int frameCount = backtrace(frames, 128);
+#if __linux__ && LOGVISOR_HAS_ELF
+  if (!PrintDeferredBacktrace(frames, size_t(frameCount)))
+#endif
+    backtrace_symbols_fd(frames, frameCount, 2);
+#ifndef NDEBUG
+  /* Let the default action produce a core dump for the original signal; it stays blocked while
+   * this handler runs, so unblock it or _exit would win */
+  signal(signum, SIG_DFL);
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, signum);
+  sigprocmask(SIG_UNBLOCK, &mask, nullptr);
+  raise(signum);
+#endif
+  _exit(1);
+#endif
+}
+
+void RegisterStandardExceptions() {
+#if !_WIN32 && !defined(__SWITCH__) && !defined(EMSCRIPTEN)
+  /* The first backtrace() loads the unwinder, which must not happen inside the handler */
+  void* frame;
+  backtrace(&frame, 1);
+#endif
+  signal(SIGABRT, AbortHandler);
+  signal(SIGSEGV, AbortHandler);
+  signal(SIGILL, AbortHandler);
+  signal(SIGFPE, AbortHandler);
+}
+
+#if SENTRY_ENABLED
+void RegisterSentry(const char* appName, const char* appVersion, const char* cacheDir) {
+  sentry_options_t *options = sentry_options_new();
+  sentry_options_set_database_path(options, cacheDir);
+  sentry_options_set_auto_session_tracking(options, true);
+  sentry_options_set_symbolize_stacktraces(options, true);
+  sentry_options_set_dsn(options, SENTRY_DSN);
+
+#ifdef NDEBUG
+  sentry_options_set_environment(options, "release");
+#else
+  sentry_options_set_environment(options, "debug");
+#endif
+
+  std::string release = fmt::format(FMT_STRING("{}@{}"), appName, appVersion);
+  sentry_options_set_release(options, release.c_str());
+
+  sentry_init(options);
+}
+#endif
+
+struct FileLogger : public RecordLogger {
+  FILE* fp = nullptr;
+  int m_fd = -1;
+  PrintedStacks m_printedStacks;
+  FileLogger(uint64_t typeHash) : RecordLogger(typeHash) {}
+  virtual void openFile() = 0;
+  void openFileIfNeeded() {
+    if (!fp) {
+      openFile();
+      /* Lines are handed over whole, so without a stdio buffer each is a single write and
+       * nothing is left behind in the process when it crashes */
+      if (fp) {
+        std::setvbuf(fp, nullptr, _IONBF, 0);
+        m_fd = FileFd(fp);
+        m_printedStacks.clear();
+      }
+    }
+  }
+  virtual void closeFile() {
+    if (fp) {
+      std::fflush(fp);
+      std::fclose(fp);
+      fp = nullptr;
+      m_fd = -1;
+    }
+  }
+  virtual ~FileLogger() { closeFile(); }
+
+  /* Assembles the complete line so it is handed to stdio in a single call */
+  static void _formatLine(fmt::memory_buffer& out, const LogRecord& rec, PrintedStacks& printed) {
+    auto it = std::back_inserter(out);
+    fmt::format_to(it, FMT_STRING("[{:5.4f} "), UptimeSeconds(rec.uptime));
+    if (rec.frameIndex != 0)
+      fmt::format_to(it, FMT_STRING("({}) "), rec.frameIndex);
+    AppendString(out, LevelName(rec.severity));
+    fmt::format_to(it, FMT_STRING(" {}"), rec.modName);
+    if (rec.file)
+      fmt::format_to(it, FMT_STRING(" {{{}:{}}}"), rec.file, rec.linenum);
+    if (rec.threadName)
+      fmt::format_to(it, FMT_STRING(" ({})"), rec.threadName);
+    AppendString(out, "] ");
+    const fmt::string_view message = rec.message();
+    out.append(message.data(), message.data() + message.size());
+    detail::AppendFields(out, rec.fields, rec.fieldCount);
+    AppendSampleRate(out, rec);
+    AppendStackReference(out, rec, printed);
+    out.push_back('\n');
+  }
+
+  void reportRecord(const LogRecord& rec) override {
+    openFileIfNeeded();
+    if (!fp)
+      return;
+    static thread_local fmt::memory_buffer LineBuf;
+    LineBuf.clear();
+    _formatLine(LineBuf, rec, m_printedStacks);
+    std::fwrite(LineBuf.data(), 1, LineBuf.size(), fp);
+    countBytes(LineBuf.size());
+  }
+
+  void reportSignalSafe(const char* line, size_t size) override {
+    if (m_fd >= 0)
+      WriteAllFd(m_fd, line, size);
+  }
+
+  const char* sinkName() const override { return "file"; }
+};
+
+struct FileLogger8 : public FileLogger {
+  const char* m_filepath;
+  explicit FileLogger8(const char* filepath) : FileLogger(log_typeid(FileLogger8)), m_filepath(filepath) {}
+  void openFile() override { fp = std::fopen(m_filepath, "a"); }
+  ~FileLogger8() override = default;
+};
+
+void RegisterFileLogger(const char* filepath) {
+  /* Otherwise construct new file logger */
+  auto lk = LockLog();
+  AddMainLogger(new FileLogger8(filepath));
+}
+
+struct BufferedFileLogger : public RecordLogger {
+  const char* m_filepath;
+  BufferedFileOptions m_options;
+  std::shared_ptr<FileSinkCounters> m_counters = std::make_shared<FileSinkCounters>();
+  int m_fd = -1;
+  bool m_openFailed = false;
+  std::unique_ptr<char[]> m_buf;
+  size_t m_size = 0;
+  MonoClock::time_point m_firstBuffered;
+  PrintedStacks m_printedStacks;
+
+  IdleFlusher m_flusher;
+
+  BufferedFileLogger(const char* filepath, const BufferedFileOptions& options)
+  : RecordLogger(log_typeid(BufferedFileLogger)), m_filepath(filepath), m_options(options) {
+    if (m_options.bufferSize == 0)
+      m_options.bufferSize = 1;
+    if (m_options.flushBytes == 0 || m_options.flushBytes > m_options.bufferSize)
+      m_options.flushBytes = m_options.bufferSize;
+    m_buf.reset(new char[m_options.bufferSize]);
+    m_flusher.start(m_options.flushInterval, [this]() {
+      if (m_size != 0 && MonoClock::now() - m_firstBuffered >= m_options.flushInterval)
+        flush();
+    });
+  }
+
+  ~BufferedFileLogger() override {
+    m_flusher.stop();
+    flush();
+    if (m_fd >= 0)
+      CloseFd(m_fd);
+  }
+
+  bool openFileIfNeeded() {
+    if (m_fd < 0 && !m_openFailed) {
+      m_fd = OpenAppendFd(m_filepath);
+      m_openFailed = m_fd < 0;
+    }
+    return m_fd >= 0;
+  }
+
+  void writeOut(const char* data, size_t size) {
+    while (size) {
+      const auto written = WriteFd(m_fd, data, size);
+      m_counters->writeCalls.fetch_add(1, std::memory_order_relaxed);
+      if (written < 0) {
+        if (errno == EINTR)
+          continue;
+        return;
+      }
+      m_counters->bytesWritten.fetch_add(uint64_t(written), std::memory_order_relaxed);
+      data += written;
+      size -= size_t(written);
+    }
+  }
+
+  /* Caller must hold the log lock */
+  void flush() {
+    if (m_size == 0 || !openFileIfNeeded())
+      return;
+    writeOut(m_buf.get(), m_size);
+    m_size = 0;
+  }
+
+  void reportRecord(const LogRecord& rec) override {
+    if (!openFileIfNeeded())
+      return;
+    static thread_local fmt::memory_buffer LineBuf;
+    LineBuf.clear();
+    FileLogger::_formatLine(LineBuf, rec, m_printedStacks);
+    countBytes(LineBuf.size());
+
+    if (m_size + LineBuf.size() > m_options.bufferSize)
+      flush();
+    if (LineBuf.size() > m_options.bufferSize) {
+      writeOut(LineBuf.data(), LineBuf.size());
+      return;
+    }
+    if (m_size == 0)
+      m_firstBuffered = MonoClock::now();
+    std::memcpy(m_buf.get() + m_size, LineBuf.data(), LineBuf.size());
+    m_size += LineBuf.size();
+
+    if (rec.severity >= m_options.flushLevel || m_size >= m_options.flushBytes ||
+        (m_options.flushInterval.count() > 0 && MonoClock::now() - m_firstBuffered >= m_options.flushInterval))
+      flush();
+  }
+
+  void reportSignalSafe(const char* line, size_t size) override {
+    if (m_fd < 0)
+      return;
+    WriteAllFd(m_fd, m_buf.get(), m_size);
+    m_size = 0;
+    WriteAllFd(m_fd, line, size);
+  }
+
+  const char* sinkName() const override { return "buffered-file"; }
+};
+
+std::shared_ptr<const FileSinkCounters> RegisterBufferedFileLogger(const char* filepath,
+                                                                  const BufferedFileOptions& options) {
+  auto* logger = new BufferedFileLogger(filepath, options);
+  std::shared_ptr<const FileSinkCounters> counters = logger->m_counters;
+  auto lk = LockLog();
+  AddMainLogger(logger);
+  return counters;
+}
+
+#if !_WIN32 && !defined(__SWITCH__)
+struct MappedFileLogger : public RecordLogger {
+  const char* m_filepath;
+  size_t m_chunkSize;
+  int m_fd = -1;
+  bool m_openFailed = false;
+  char* m_map = nullptr;
+  size_t m_capacity = 0;
+  size_t m_offset = 0;
+  PrintedStacks m_printedStacks;
+
+  MappedFileLogger(const char* filepath, size_t chunkSize)
+  : RecordLogger(log_typeid(MappedFileLogger)), m_filepath(filepath) {
+    const size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+    m_chunkSize = std::max(pageSize, (chunkSize + pageSize - 1) / pageSize * pageSize);
+  }
+
+  ~MappedFileLogger() override {
+    unmap();
+    if (m_fd >= 0) {
+      /* Drop the unused preallocation so a cleanly closed log is plain text */
+      if (ftruncate(m_fd, off_t(m_offset)) != 0) {}
+      close(m_fd);
+    }
+  }
+
+  void unmap() {
+    if (m_map) {
+      munmap(m_map, m_capacity);
+      m_map = nullptr;
+      m_capacity = 0;
+    }
+  }
+
+  /* The old mapping is kept if the new one fails, so records that fit it can still be written */
+  bool map(size_t capacity) {
+    void* map = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (map == MAP_FAILED)
+      return false;
+    unmap();
+    m_map = static_cast<char*>(map);
+    m_capacity = capacity;
+    return true;
+  }
+
+  /*
+   * After a crash the file ends in zeroed preallocation, possibly preceded by a record that was
+   * cut short. Resume after the last newline before the zeros and clear anything past it.
+   */
+  void recover() {
+    size_t end = m_capacity;
+    while (end && m_map[end - 1] == '\0')
+      --end;
+    size_t resume = end;
+    while (resume && m_map[resume - 1] != '\n')
+      --resume;
+    std::memset(m_map + resume, 0, end - resume);
+    m_offset = resume;
+  }
+
+  bool openFileIfNeeded() {
+    if (m_fd >= 0 || m_openFailed)
+      return m_fd >= 0;
+    m_fd = open(m_filepath, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    struct stat st;
+    if (m_fd >= 0 && fstat(m_fd, &st) == 0 && (st.st_size == 0 || map(size_t(st.st_size)))) {
+      if (m_map)
+        recover();
+      return true;
+    }
+    if (m_fd >= 0)
+      close(m_fd);
+    m_fd = -1;
+    m_openFailed = true;
+    return false;
+  }
+
+  /* Extends the file by whole chunks; blocks are allocated up front so a full disk fails here, not as SIGBUS */
+  bool grow(size_t required) {
+    const size_t capacity = (required + m_chunkSize - 1) / m_chunkSize * m_chunkSize;
+#if __linux__
+    if (posix_fallocate(m_fd, 0, off_t(capacity)) != 0)
+      return false;
+#else
+    if (ftruncate(m_fd, off_t(capacity)) != 0)
+      return false;
+#endif
+    return map(capacity);
+  }
+
+  void reportRecord(const LogRecord& rec) override {
+    if (!openFileIfNeeded())
+      return;
+    static thread_local fmt::memory_buffer LineBuf;
+    LineBuf.clear();
+    FileLogger::_formatLine(LineBuf, rec, m_printedStacks);
+    if ((!m_map || m_offset + LineBuf.size() > m_capacity) && !grow(m_offset + LineBuf.size()))
+      return;
+
+    /* The terminating newline is stored last, so a record interrupted mid-copy is never taken as complete */
+    char* dst = m_map + m_offset;
+    std::memcpy(dst, LineBuf.data(), LineBuf.size() - 1);
+    std::atomic_signal_fence(std::memory_order_release);
+    dst[LineBuf.size() - 1] = '\n';
+    m_offset += LineBuf.size();
+    countBytes(LineBuf.size());
+  }
+
+  /* Growing the mapping is not signal-safe, so the line is kept only if the current chunk has room */
+  void reportSignalSafe(const char* line, size_t size) override {
+    if (!m_map || size == 0 || m_offset + size > m_capacity)
+      return;
+    char* dst = m_map + m_offset;
+    std::memcpy(dst, line, size - 1);
+    std::atomic_signal_fence(std::memory_order_release);
+    dst[size - 1] = '\n';
+    m_offset += size;
+  }
+
+  const char* sinkName() const override { return "mapped-file"; }
+};
+#endif
+
+void RegisterMappedFileLogger(const char* filepath, size_t chunkSize) {
+  auto lk = LockLog();
+#if !_WIN32 && !defined(__SWITCH__)
+  AddMainLogger(new MappedFileLogger(filepath, chunkSize));
+#else
+  AddMainLogger(new FileLogger8(filepath));
+#endif
+}
+
+#if LOGVISOR_HAS_IO_URING
+struct UringFileLogger : public RecordLogger {
+  struct Block {
+    std::unique_ptr<char[]> data;
+    size_t size = 0;
+    uint64_t offset = 0;
+  };
+
+  const char* m_filepath;
+  UringFileOptions m_options;
+  std::shared_ptr<FileSinkCounters> m_counters = std::make_shared<FileSinkCounters>();
+  int m_fd = -1;
+  bool m_openFailed = false;
+  uint64_t m_fileOffset = 0;
+  std::vector<Block> m_blocks;
+  std::vector<unsigned> m_freeBlocks;
+  unsigned m_current = 0;
+  unsigned m_inFlight = 0;
+  std::optional<uring::Ring> m_ring;
+  bool m_useRing = false;
+  bool m_registered = false;
+  PrintedStacks m_printedStacks;
+
+  UringFileLogger(const char* filepath, const UringFileOptions& options)
+  : RecordLogger(log_typeid(UringFileLogger)), m_filepath(filepath), m_options(options) {
+    m_options.blockSize = std::clamp(m_options.blockSize, size_t(4096), size_t(1) << 30);
+    m_options.blockCount = std::max(m_options.blockCount, 2u);
+    m_blocks.resize(m_options.blockCount);
+    for (unsigned i = 0; i < m_options.blockCount; ++i) {
+      m_blocks[i].data.reset(new char[m_options.blockSize]);
+      if (i != 0)
+        m_freeBlocks.push_back(i);
+    }
+  }
+
+  ~UringFileLogger() override {
+    if (m_fd < 0)
+      return;
+    submitCurrent();
+    waitAll();
+    m_ring.reset();
+    close(m_fd);
+  }
+
+  bool openFileIfNeeded() {
+    if (m_fd >= 0 || m_openFailed)
+      return m_fd >= 0;
+    /* Writes carry explicit offsets so blocks may complete out of order */
+    m_fd = open(m_filepath, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+    const off_t end = m_fd >= 0 ? lseek(m_fd, 0, SEEK_END) : -1;
+    if (end < 0) {
+      if (m_fd >= 0)
+        close(m_fd);
+      m_fd = -1;
+      m_openFailed = true;
+      return false;
+    }
+    m_fileOffset = uint64_t(end);
+
+    m_ring.emplace();
+    if (!m_ring->init(m_options.blockCount)) {
+      m_ring.reset();
+      return true;
+    }
+    m_useRing = true;
+    std::vector<iovec> iovs(m_blocks.size());
+    for (size_t i = 0; i < m_blocks.size(); ++i)
+      iovs[i] = {m_blocks[i].data.get(), m_options.blockSize};
+    m_registered = m_ring->registerBuffers(iovs.data(), unsigned(iovs.size()));
+    return true;
+  }
+
+  void writeSync(const char* data, size_t size, uint64_t offset) {
+    while (size) {
+      const ssize_t written = pwrite(m_fd, data, size, off_t(offset));
+      m_counters->writeCalls.fetch_add(1, std::memory_order_relaxed);
+      if (written < 0) {
+        if (errno == EINTR)
+          continue;
+        return;
+      }
+      m_counters->bytesWritten.fetch_add(uint64_t(written), std::memory_order_relaxed);
+      data += written;
+      offset += uint64_t(written);
+      size -= size_t(written);
+    }
+  }
+
+  void complete(uint64_t index, int res) {
+    Block& block = m_blocks[index];
+    const size_t written = res > 0 ? size_t(res) : 0;
+    m_counters->bytesWritten.fetch_add(written, std::memory_order_relaxed);
+    if (written < block.size) {
+      /* Short write or an opcode this kernel rejects; finish synchronously and stop submitting to the ring */
+      if (res < 0)
+        m_useRing = false;
+      writeSync(block.data.get() + written, block.size - written, block.offset + written);
+    }
+    block.size = 0;
+    m_freeBlocks.push_back(unsigned(index));
+    --m_inFlight;
+  }
+
+  void reap() {
+    if (m_ring)
+      m_ring->reap([this](uint64_t index, int res) { complete(index, res); });
+  }
+
+  void waitAll() {
+    while (m_inFlight) {
+      if (!m_ring->submit(1))
+        std::this_thread::yield();
+      reap();
+    }
+  }
+
+  /* Hands the current block to the kernel at the next file offset and moves on to a free block */
+  void submitCurrent() {
+    Block& block = m_blocks[m_current];
+    if (block.size == 0)
+      return;
+    block.offset = m_fileOffset;
+    m_fileOffset += block.size;
+    if (m_useRing &&
+        m_ring->prepWrite(m_fd, block.data.get(), unsigned(block.size), block.offset, m_registered ? int(m_current) : -1,
+                          m_current)) {
+      m_counters->writeCalls.fetch_add(1, std::memory_order_relaxed);
+      ++m_inFlight;
+      m_ring->submit();
+    } else {
+      writeSync(block.data.get(), block.size, block.offset);
+      block.size = 0;
+      m_freeBlocks.push_back(m_current);
+    }
+
+    reap();
+    while (m_freeBlocks.empty()) {
+      if (!m_ring->submit(1))
+        std::this_thread::yield();
+      reap();
+    }
+    m_current = m_freeBlocks.back();
+    m_freeBlocks.pop_back();
+  }
+
+  void reportRecord(const LogRecord& rec) override {
+    if (!openFileIfNeeded())
+      return;
+    static thread_local fmt::memory_buffer LineBuf;
+    LineBuf.clear();
+    FileLogger::_formatLine(LineBuf, rec, m_printedStacks);
+    countBytes(LineBuf.size());
+
+    Block* block = &m_blocks[m_current];
+    if (block->size + LineBuf.size() > m_options.blockSize) {
+      submitCurrent();
+      block = &m_blocks[m_current];
+    }
+    if (LineBuf.size() > m_options.blockSize) {
+      writeSync(LineBuf.data(), LineBuf.size(), m_fileOffset);
+      m_fileOffset += LineBuf.size();
+    } else {
+      std::memcpy(block->data.get() + block->size, LineBuf.data(), LineBuf.size());
+      block->size += LineBuf.size();
+    }
+
+    if (rec.severity >= m_options.flushLevel)
+      submitCurrent();
+    if (rec.severity == Fatal)
+      waitAll();
+    else
+      reap();
+  }
+
+  /* Blocks already submitted are left to the kernel; the current block and the line go out with pwrite */
+  void reportSignalSafe(const char* line, size_t size) override {
+    if (m_fd < 0)
+      return;
+    Block& block = m_blocks[m_current];
+    writeSync(block.data.get(), block.size, m_fileOffset);
+    m_fileOffset += block.size;
+    block.size = 0;
+    writeSync(line, size, m_fileOffset);
+    m_fileOffset += size;
+  }
+
+  const char* sinkName() const override { return "uring-file"; }
+};
+#endif
+
+std::shared_ptr<const FileSinkCounters> RegisterUringFileLogger(const char* filepath, const UringFileOptions& options) {
+#if LOGVISOR_HAS_IO_URING
+  auto* logger = new UringFileLogger(filepath, options);
+  std::shared_ptr<const FileSinkCounters> counters = logger->m_counters;
+  auto lk = LockLog();
+  AddMainLogger(logger);
+  return counters;
+#else
+  BufferedFileOptions buffered;
+  buffered.bufferSize = options.blockSize;
+  buffered.flushBytes = 0;
+  buffered.flushLevel = options.flushLevel;
+  return RegisterBufferedFileLogger(filepath, buffered);
+#endif
+}
+
+/* Bumped by SIGHUP (or ReopenLogFiles); rotating loggers reopen their file when it changes */
+static std::atomic_uint ReopenGeneration{0};
+
+void ReopenLogFiles() { ReopenGeneration.fetch_add(1, std::memory_order_relaxed); }
+
+#if defined(SIGHUP) && !defined(__SWITCH__)
+static void ReopenHandler(int) { ReopenLogFiles(); }
+
+/* Leaves SIGHUP alone if the application already handles it */
+static void InstallReopenHandler() {
+  static std::once_flag Once;
+  std::call_once(Once, [] {
+    struct sigaction current;
+    if (sigaction(SIGHUP, nullptr, &current) == 0 && current.sa_handler == SIG_DFL)
+      signal(SIGHUP, ReopenHandler);
+  });
+}
+#else
+static void InstallReopenHandler() {}
+#endif
+
+/* Closed segments of a rotating log as (sequence, path), oldest first */
+static std::vector<std::pair<uint64_t, std::filesystem::path>> ListSegments(const std::filesystem::path& filepath) {
+  std::vector<std::pair<uint64_t, std::filesystem::path>> segments;
+  const std::string prefix = filepath.filename().string() + '.';
+  std::error_code ec;
+  std::filesystem::path dir = filepath.parent_path();
+  if (dir.empty())
+    dir = ".";
+  for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+    const std::string name = entry.path().filename().string();
+    if (name.compare(0, prefix.size(), prefix) != 0)
+      continue;
+    std::string_view suffix = std::string_view(name).substr(prefix.size());
+    if (suffix.size() > 3 && suffix.substr(suffix.size() - 3) == ".gz")
+      suffix.remove_suffix(3);
+    if (suffix.empty() || suffix.size() > 19 ||
+        !std::all_of(suffix.begin(), suffix.end(), [](char c) { return c >= '0' && c <= '9'; }))
+      continue;
+    segments.emplace_back(std::stoull(std::string(suffix)), entry.path());
+  }
+  std::sort(segments.begin(), segments.end());
+  return segments;
+}
+
+#if LOGVISOR_HAS_ZLIB
+/* Replaces path with path.gz; gives up early (leaving path in place) if stopping is raised */
+static bool CompressSegment(const std::filesystem::path& path, const std::atomic_bool& stopping) {
+  std::filesystem::path gzPath = path;
+  gzPath += ".gz";
+  std::filesystem::path tmpPath = gzPath;
+  tmpPath += ".tmp";
+  FILE* in = std::fopen(path.string().c_str(), "rb");
+  if (!in)
+    return false;
+  gzFile out = gzopen(tmpPath.string().c_str(), "wb6");
+  if (!out) {
+    std::fclose(in);
+    return false;
+  }
+  std::unique_ptr<char[]> buf(new char[65536]);
+  bool ok = true;
+  size_t size;
+  while (ok && (size = std::fread(buf.get(), 1, 65536, in)) != 0)
+    ok = !stopping.load(std::memory_order_relaxed) && gzwrite(out, buf.get(), unsigned(size)) == int(size);
+  ok = ok && !std::ferror(in);
+  std::fclose(in);
+  ok = gzclose(out) == Z_OK && ok;
+  std::error_code ec;
+  if (ok)
+    std::filesystem::rename(tmpPath, gzPath, ec);
+  if (!ok || ec) {
+    std::filesystem::remove(tmpPath, ec);
+    return false;
+  }
+  std::filesystem::remove(path, ec);
+  return true;
+}
+#endif
+
+struct RotatingFileLogger : public RecordLogger {
+  std::string m_filepath;
+  RotatingFileOptions m_options;
+  FILE* m_fp = nullptr;
+  int m_fd = -1;
+  bool m_openFailed = false;
+  uint64_t m_fileSize = 0;
+  MonoClock::time_point m_openedAt;
+  unsigned m_reopenGeneration;
+  uint64_t m_nextSegment = 1;
+  PrintedStacks m_printedStacks;
+
+  /* Compression and pruning of closed segments happen on a low-priority worker */
+  std::thread m_worker;
+  std::mutex m_workerMutex;
+  std::condition_variable m_workerCv;
+  std::deque<std::filesystem::path> m_closedSegments;
+  std::atomic_bool m_stopping{false};
+
+  RotatingFileLogger(const char* filepath, const RotatingFileOptions& options)
+  : RecordLogger(log_typeid(RotatingFileLogger))
+  , m_filepath(filepath)
+  , m_options(options)
+  , m_reopenGeneration(ReopenGeneration.load(std::memory_order_relaxed)) {
+    /* Continue numbering after segments from earlier runs, and finish any they left uncompressed */
+    for (const auto& [sequence, path] : ListSegments(m_filepath)) {
+      m_nextSegment = sequence + 1;
+      if (path.extension() != ".gz")
+        m_closedSegments.push_back(path);
+    }
+    if (m_options.reopenOnSighup)
+      InstallReopenHandler();
+    m_worker = std::thread(&RotatingFileLogger::workerMain, this);
+  }
+
+  ~RotatingFileLogger() override {
+    closeFile();
+    {
+      std::lock_guard<std::mutex> lk(m_workerMutex);
+      m_stopping.store(true);
+    }
+    m_workerCv.notify_one();
+    m_worker.join();
+  }
+
+  bool openFileIfNeeded() {
+    if (m_fp || m_openFailed)
+      return m_fp != nullptr;
+    m_fp = std::fopen(m_filepath.c_str(), "a");
+    if (!m_fp) {
+      m_openFailed = true;
+      return false;
+    }
+    /* As in FileLogger, each line is a single write and none is held in stdio at a crash */
+    std::setvbuf(m_fp, nullptr, _IONBF, 0);
+    m_fd = FileFd(m_fp);
+    std::fseek(m_fp, 0, SEEK_END);
+    const long size = std::ftell(m_fp);
+    m_fileSize = size > 0 ? uint64_t(size) : 0;
+    m_openedAt = MonoClock::now();
+    m_printedStacks.clear();
+    return true;
+  }
+
+  void closeFile() {
+    if (m_fp) {
+      std::fclose(m_fp);
+      m_fp = nullptr;
+      m_fd = -1;
+    }
+    m_openFailed = false;
+  }
+
+  /* Producers only pay for close, rename and open; everything else is queued for the worker */
+  void roll() {
+    closeFile();
+    std::filesystem::path segment = m_filepath;
+    segment += fmt::format(FMT_STRING(".{}"), m_nextSegment++);
+    std::error_code ec;
+    std::filesystem::rename(m_filepath, segment, ec);
+    if (!ec) {
+      {
+        std::lock_guard<std::mutex> lk(m_workerMutex);
+        m_closedSegments.push_back(std::move(segment));
+      }
+      m_workerCv.notify_one();
+    }
+    openFileIfNeeded();
+  }
+
+  void prune() {
+    if (!m_options.maxFiles && !m_options.maxTotalBytes)
+      return;
+    const auto segments = ListSegments(m_filepath);
+    std::error_code ec;
+    std::vector<uint64_t> sizes;
+    uint64_t total = 0;
+    for (const auto& segment : segments) {
+      const auto size = std::filesystem::file_size(segment.second, ec);
+      sizes.push_back(ec ? 0 : uint64_t(size));
+      total += sizes.back();
+    }
+    for (size_t i = 0; i < segments.size(); ++i) {
+      const bool overCount = m_options.maxFiles && segments.size() - i > m_options.maxFiles;
+      const bool overSize = m_options.maxTotalBytes && total > m_options.maxTotalBytes;
+      if (!overCount && !overSize)
+        break;
+      std::filesystem::remove(segments[i].second, ec);
+      total -= sizes[i];
+    }
+  }
+
+  void workerMain() {
+#if __linux__
+    setpriority(PRIO_PROCESS, pid_t(syscall(SYS_gettid)), 19);
+#elif __APPLE__
+    setpriority(PRIO_DARWIN_THREAD, 0, PRIO_DARWIN_BG);
+#elif _WIN32
+    SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST);
+#endif
+    bool pruned = false;
+    std::unique_lock<std::mutex> lk(m_workerMutex);
+    while (!m_stopping.load()) {
+      if (m_closedSegments.empty()) {
+        if (!pruned) {
+          lk.unlock();
+          prune();
+          lk.lock();
+          pruned = true;
+        }
+        m_workerCv.wait(lk);
+        continue;
+      }
+      const std::filesystem::path segment = std::move(m_closedSegments.front());
+      m_closedSegments.pop_front();
+      lk.unlock();
+#if LOGVISOR_HAS_ZLIB
+      if (m_options.compress)
+        CompressSegment(segment, m_stopping);
+#endif
+      lk.lock();
+      pruned = false;
+    }
+  }
+
+  void reportRecord(const LogRecord& rec) override {
+    const unsigned generation = ReopenGeneration.load(std::memory_order_relaxed);
+    if (generation != m_reopenGeneration) {
+      m_reopenGeneration = generation;
+      closeFile();
+    }
+    if (!openFileIfNeeded())
+      return;
+    static thread_local fmt::memory_buffer LineBuf;
+    LineBuf.clear();
+    FileLogger::_formatLine(LineBuf, rec, m_printedStacks);
+
+    if (m_fileSize != 0 &&
+        ((m_options.maxFileSize && m_fileSize + LineBuf.size() > m_options.maxFileSize) ||
+         (m_options.interval.count() > 0 && MonoClock::now() - m_openedAt >= m_options.interval))) {
+      roll();
+      if (!m_fp)
+        return;
+      /* The new segment has printed no stacks yet */
+      if (rec.stackId) {
+        LineBuf.clear();
+        FileLogger::_formatLine(LineBuf, rec, m_printedStacks);
+      }
+    }
+    std::fwrite(LineBuf.data(), 1, LineBuf.size(), m_fp);
+    m_fileSize += LineBuf.size();
+    countBytes(LineBuf.size());
+  }
+
+  void reportSignalSafe(const char* line, size_t size) override {
+    if (m_fd >= 0)
+      WriteAllFd(m_fd, line, size);
+  }
+
+  const char* sinkName() const override { return "rotating-file"; }
+};
+
+void RegisterRotatingFileLogger(const char* filepath, const RotatingFileOptions& options) {
+  auto* logger = new RotatingFileLogger(filepath, options);
+  auto lk = LockLog();
+  AddMainLogger(logger);
+}
+
+/* Formats an argument pack encoded by a deferred report */
+static void FormatDeferred(detail::DeferredDecodeFunc decode, const uint8_t* src, fmt::string_view format,
+                           fmt::memory_buffer& out) {
+  struct Context {
+    fmt::string_view format;
+    fmt::memory_buffer& out;
+  } context{format, out};
+  decode(
+      src,
+      [](fmt::format_args args, void* ptr) {
+        auto& ctx = *static_cast<Context*>(ptr);
+        fmt::vformat_to(std::back_inserter(ctx.out), ctx.format, args);
+      },
+      &context);
+}
+
+/* Allocated once and never released, so the ring is still there if the crash happens during exit */
+static char* AllocatePersistent(size_t size) {
+#if _WIN32
+  return static_cast<char*>(VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE));
+#elif defined(__SWITCH__) || defined(EMSCRIPTEN)
+  return static_cast<char*>(std::calloc(size, 1));
+#else
+  int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_POPULATE
+  flags |= MAP_POPULATE;
+#endif
+  void* map = mmap(nullptr, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+  return map == MAP_FAILED ? nullptr : static_cast<char*>(map);
+#endif
+}
+
+/*
+ * Ring of the most recent records, written by the reporting threads themselves before any
+ * filtering. Each record is guarded by a sequence number (odd while being written), so the
+ * dump can skip records that were torn by a concurrent writer.
+ */
+class FlightRecorder {
+  struct Record {
+    std::atomic_uint64_t seq;
+    MonoClock::rep ticks;
+    uint64_t frameIndex;
+    const char* modName;
+    const char* threadName;
+    const char* file;
+    /* Static format string and the decoder for the encoded arguments in the payload,
+     * or nullptr if the payload is the rendered message */
+    const char* format;
+    detail::DeferredDecodeFunc decode;
+    uint32_t formatSize;
+    uint32_t payloadSize;
+    uint32_t linenum;
+    Level severity;
+    bool truncated;
+  };
+
+  char* m_records;
+  size_t m_recordSize;
+  size_t m_mask;
+  std::atomic_uint64_t m_next{0};
+  std::atomic<const char*> m_dumpPath{nullptr};
+  std::atomic_bool m_dumping{false};
+  /* Dump scratch space, reserved up front since the dump may run inside a signal handler */
+  std::unique_ptr<char[]> m_dumpCopy;
+  fmt::memory_buffer m_dumpMessage;
+  fmt::memory_buffer m_dumpLine;
+
+  Record& record(uint64_t ticket) {
+    return *reinterpret_cast<Record*>(m_records + (ticket & m_mask) * m_recordSize);
+  }
+  static char* payload(Record& rec) { return reinterpret_cast<char*>(&rec + 1); }
+  static const char* payload(const Record& rec) { return reinterpret_cast<const char*>(&rec + 1); }
+  size_t payloadCapacity() const { return m_recordSize - sizeof(Record); }
+
+  /* Takes the record for this ticket; nullptr if a writer from another lap of the ring holds it */
+  Record* begin(uint64_t ticket, const char* modName, Level severity, const char* file, unsigned linenum) {
+    Record& rec = record(ticket);
+    uint64_t seq = rec.seq.load(std::memory_order_relaxed);
+    do {
+      if ((seq & 1) || seq > ticket * 2)
+        return nullptr;
+    } while (!rec.seq.compare_exchange_weak(seq, ticket * 2 + 1, std::memory_order_acquire, std::memory_order_relaxed));
+    std::atomic_thread_fence(std::memory_order_release);
+    rec.ticks = CurrentUptime().count();
+    rec.frameIndex = FrameIndex.load(std::memory_order_relaxed);
+    rec.modName = modName;
+    rec.threadName = CurrentThreadName;
+    rec.file = file;
+    rec.linenum = linenum;
+    rec.severity = severity;
+    rec.truncated = false;
+    return &rec;
+  }
+
+  void storeText(Record& rec, const fmt::memory_buffer& text) {
+    const size_t size = std::min(text.size(), payloadCapacity());
+    std::memcpy(payload(rec), text.data(), size);
+    rec.payloadSize = uint32_t(size);
+    rec.truncated = size < text.size();
+    rec.format = nullptr;
+    rec.decode = nullptr;
+  }
+
+public:
+  explicit FlightRecorder(const FlightRecorderOptions& options) {
+    size_t count = 1;
+    while (count < std::max(options.records, size_t(2)))
+      count <<= 1;
+    m_mask = count - 1;
+    m_recordSize = std::max(options.recordSize, sizeof(Record) + 64);
+    m_recordSize = (m_recordSize + alignof(Record) - 1) / alignof(Record) * alignof(Record);
+    m_records = AllocatePersistent(count * m_recordSize);
+    m_dumpCopy.reset(new char[m_recordSize]);
+    m_dumpMessage.reserve(m_recordSize + 4096);
+    m_dumpLine.reserve(m_recordSize + 4096);
+  }
+
+  bool valid() const { return m_records != nullptr; }
+  void setDumpPath(const char* path) { m_dumpPath.store(path, std::memory_order_relaxed); }
+
+  void recordFormatted(const char* modName, Level severity, const char* file, unsigned linenum,
+                       fmt::string_view format, fmt::format_args args) {
+    const uint64_t ticket = m_next.fetch_add(1, std::memory_order_relaxed);
+    Record* rec = begin(ticket, modName, severity, file, linenum);
+    if (!rec)
+      return;
+    MessageBuffer buf;
+    buf.get().clear();
+    fmt::vformat_to(std::back_inserter(buf.get()), format, args);
+    storeText(*rec, buf.get());
+    rec->seq.store(ticket * 2 + 2, std::memory_order_release);
+  }
+
+  void recordDeferred(const char* modName, Level severity, const char* file, unsigned linenum,
+                      fmt::string_view format, size_t argsSize, detail::DeferredEncodeFunc encode, const void* args,
+                      detail::DeferredDecodeFunc decode) {
+    const uint64_t ticket = m_next.fetch_add(1, std::memory_order_relaxed);
+    Record* rec = begin(ticket, modName, severity, file, linenum);
+    if (!rec)
+      return;
+    if (argsSize <= payloadCapacity()) {
+      encode(reinterpret_cast<uint8_t*>(payload(*rec)), args);
+      rec->payloadSize = uint32_t(argsSize);
+      rec->format = format.data();
+      rec->formatSize = uint32_t(format.size());
+      rec->decode = decode;
+    } else {
+      /* Too large to keep raw; render it and keep what fits */
+      static thread_local std::vector<uint8_t> Encoded;
+      Encoded.resize(argsSize);
+      encode(Encoded.data(), args);
+      MessageBuffer buf;
+      buf.get().clear();
+      FormatDeferred(decode, Encoded.data(), format, buf.get());
+      storeText(*rec, buf.get());
+    }
+    rec->seq.store(ticket * 2 + 2, std::memory_order_release);
+  }
+
+  /* Copies the record for this ticket into the dump scratch space; false if it was torn or overwritten */
+  bool copyRecord(uint64_t ticket) {
+    Record& rec = record(ticket);
+    const uint64_t seq = rec.seq.load(std::memory_order_acquire);
+    if (seq != ticket * 2 + 2)
+      return false;
+    std::memcpy(static_cast<void*>(m_dumpCopy.get() + sizeof(std::atomic_uint64_t)),
+                reinterpret_cast<const char*>(&rec) + sizeof(std::atomic_uint64_t),
+                m_recordSize - sizeof(std::atomic_uint64_t));
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return rec.seq.load(std::memory_order_relaxed) == seq;
+  }
+
+  /* Takes the dump and opens its destination; -1 if another dump is running or the file can't be opened */
+  int beginDump() {
+    if (m_dumping.exchange(true))
+      return -1;
+    const char* path = m_dumpPath.load(std::memory_order_relaxed);
+    const int fd = path ? OpenAppendFd(path) : 2;
+    if (fd < 0)
+      m_dumping.store(false);
+    return fd;
+  }
+
+  void endDump(int fd) {
+    if (fd != 2)
+      CloseFd(fd);
+    m_dumping.store(false);
+  }
+
+  void dump() {
+    const int fd = beginDump();
+    if (fd < 0)
+      return;
+    if (fd == 2)
+      std::fflush(stderr);
+
+    auto& copy = *reinterpret_cast<Record*>(m_dumpCopy.get());
+    fmt::memory_buffer& message = m_dumpMessage;
+    fmt::memory_buffer& line = m_dumpLine;
+    PrintedStacks printed; /* Recorded events carry no stacks */
+    line.clear();
+    const uint64_t end = m_next.load(std::memory_order_acquire);
+    const uint64_t start = end > m_mask ? end - m_mask - 1 : 0;
+    fmt::format_to(std::back_inserter(line), FMT_STRING("--- flight recorder: {} most recent records ---\n"),
+                   end - start);
+    WriteAllFd(fd, line.data(), line.size());
+
+    for (uint64_t ticket = start; ticket != end; ++ticket) {
+      if (!copyRecord(ticket))
+        continue;
+
+      message.clear();
+      if (copy.decode)
+        FormatDeferred(copy.decode, reinterpret_cast<const uint8_t*>(payload(copy)),
+                       fmt::string_view(copy.format, copy.formatSize), message);
+      else
+        message.append(payload(copy), payload(copy) + copy.payloadSize);
+      if (copy.truncated)
+        AppendString(message, "...");
+
+      const fmt::string_view text(message.data(), message.size());
+      const auto args = fmt::make_format_args(text);
+      const LogRecord logRec{copy.modName,   copy.severity,   copy.file,
+                             copy.linenum,   "{}",            args,
+                             MonoClock::duration(copy.ticks), copy.frameIndex, copy.threadName,
+                             nullptr,        text,            &message};
+      line.clear();
+      FileLogger::_formatLine(line, logRec, printed);
+      WriteAllFd(fd, line.data(), line.size());
+    }
+
+    endDump(fd);
+  }
+
+  /*
+   * Crash handler variant: no stdio, fmt or decoder callbacks, so records with deferred
+   * arguments are written as their format string. Lines are truncated at 1 KiB.
+   */
+  void dumpSignalSafe() {
+    const int fd = beginDump();
+    if (fd < 0)
+      return;
+
+    const auto& copy = *reinterpret_cast<const Record*>(m_dumpCopy.get());
+    const uint64_t end = m_next.load(std::memory_order_acquire);
+    const uint64_t start = end > m_mask ? end - m_mask - 1 : 0;
+    SignalSafeLine header;
+    header.append("--- flight recorder: ");
+    header.append(end - start, 10);
+    header.append(" most recent records ---");
+    header.endLine();
+    header.write(fd);
+
+    for (uint64_t ticket = start; ticket != end; ++ticket) {
+      if (!copyRecord(ticket))
+        continue;
+      SignalSafeLine line;
+      AppendSignalSafeHead(line, MonoClock::duration(copy.ticks), copy.frameIndex, copy.severity, copy.modName,
+                           copy.file, copy.linenum, copy.threadName);
+      if (copy.decode) {
+        line.append(copy.format, copy.formatSize);
+        line.append(" (arguments not rendered)");
+      } else {
+        line.append(payload(copy), copy.payloadSize);
+        if (copy.truncated)
+          line.append("...");
+      }
+      line.endLine();
+      line.write(fd);
+    }
+
+    endDump(fd);
+  }
+};
+
+static std::atomic<FlightRecorder*> ActiveFlightRecorder{nullptr};
+std::atomic_int detail::FlightRecorderLevel{Fatal + 1};
+
+void EnableFlightRecorder(const FlightRecorderOptions& options) {
+  static std::mutex EnableMutex;
+  std::lock_guard<std::mutex> lk(EnableMutex);
+  FlightRecorder* recorder = ActiveFlightRecorder.load(std::memory_order_acquire);
+  if (!recorder) {
+    recorder = new FlightRecorder(options);
+    if (!recorder->valid()) {
+      delete recorder;
+      return;
+    }
+    ActiveFlightRecorder.store(recorder, std::memory_order_release);
+  }
+  recorder->setDumpPath(options.dumpPath);
+  detail::FlightRecorderLevel.store(options.level, std::memory_order_relaxed);
+}
+
+void DisableFlightRecorder() { detail::FlightRecorderLevel.store(Fatal + 1, std::memory_order_relaxed); }
+
+void DumpFlightRecorder() {
+  if (FlightRecorder* recorder = ActiveFlightRecorder.load(std::memory_order_acquire))
+    recorder->dump();
+}
+
+static void DumpFlightRecorderSignalSafe() {
+  if (FlightRecorder* recorder = ActiveFlightRecorder.load(std::memory_order_acquire))
+    recorder->dumpSignalSafe();
+}
+
+void detail::FlightRecordFormatted(const char* modName, Level severity, const char* file, unsigned linenum,
+                                   fmt::string_view format, fmt::format_args args) {
+  if (FlightRecorder* recorder = ActiveFlightRecorder.load(std::memory_order_acquire))
+    recorder->recordFormatted(modName, severity, file, linenum, format, args);
+}
+
+void detail::FlightRecordDeferred(const char* modName, Level severity, const char* file, unsigned linenum,
+                                  fmt::string_view format, size_t argsSize, DeferredEncodeFunc encode,
+                                  const void* args, DeferredDecodeFunc decode) {
+  if (FlightRecorder* recorder = ActiveFlightRecorder.load(std::memory_order_acquire))
+    recorder->recordDeferred(modName, severity, file, linenum, format, argsSize, encode, args, decode);
+}
+
+void detail::FlightRecordFields(const char* modName, Level severity, const char* file, unsigned linenum,
+                                fmt::string_view message, const Field* fields, size_t count) {
+  FlightRecorder* recorder = ActiveFlightRecorder.load(std::memory_order_acquire);
+  if (!recorder)
+    return;
+  static thread_local fmt::memory_buffer TextBuf;
+  TextBuf.clear();
+  TextBuf.append(message.data(), message.data() + message.size());
+  AppendFields(TextBuf, fields, count);
+  const fmt::string_view text(TextBuf.data(), TextBuf.size());
+  recorder->recordFormatted(modName, severity, file, linenum, "{}", fmt::make_format_args(text));
+}
+
+struct BinaryFileLogger : public RecordLogger {
+  const char* m_filepath;
+  FILE* m_fp = nullptr;
+  std::deque<std::string> m_strings;
+  std::unordered_map<std::string_view, uint64_t> m_stringIds;
+  struct SiteIds {
+    uint64_t format;
+    uint64_t file;
+  };
+  std::unordered_map<const CallSite*, SiteIds> m_siteIds;
+  std::unordered_set<uint32_t> m_stackIds;
+  std::vector<uint8_t> m_out;
+  std::vector<uint8_t> m_args;
+  size_t m_argCount = 0;
+  fmt::memory_buffer m_text;
+  MonoClock::rep m_lastTicks = 0;
+
+  explicit BinaryFileLogger(const char* filepath)
+  : RecordLogger(log_typeid(BinaryFileLogger)), m_filepath(filepath) {}
+  ~BinaryFileLogger() override {
+    if (m_fp)
+      std::fclose(m_fp);
+  }
+
+  static void putVarint(std::vector<uint8_t>& buf, uint64_t val) {
+    uint8_t tmp[binlog::MaxVarintSize];
+    buf.insert(buf.end(), tmp, binlog::PutVarint(tmp, val));
+  }
+
+  static void putBytes(std::vector<uint8_t>& buf, const void* data, size_t size) {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    buf.insert(buf.end(), bytes, bytes + size);
+  }
+
+  static void putString(std::vector<uint8_t>& buf, std::string_view str) {
+    putVarint(buf, str.size());
+    putBytes(buf, str.data(), str.size());
+  }
+
+  bool openFileIfNeeded() {
+    if (m_fp)
+      return true;
+    m_fp = std::fopen(m_filepath, "ab");
+    if (!m_fp)
+      return false;
+    m_strings.clear();
+    m_stringIds.clear();
+    m_siteIds.clear();
+    m_stackIds.clear();
+    m_lastTicks = 0;
+    putBytes(m_out, binlog::SessionMagic, sizeof(binlog::SessionMagic));
+    putVarint(m_out, MonoClock::period::num);
+    putVarint(m_out, MonoClock::period::den);
+    return true;
+  }
+
+  /* New strings are defined in the stream ahead of the event referencing them */
+  uint64_t intern(std::string_view str) {
+    auto search = m_stringIds.find(str);
+    if (search != m_stringIds.end())
+      return search->second;
+    const uint64_t id = m_stringIds.size() + 1;
+    m_stringIds.emplace(m_strings.emplace_back(str), id);
+    m_out.push_back(uint8_t(binlog::Tag::String));
+    putVarint(m_out, id);
+    putString(m_out, str);
+    return id;
+  }
+
+  /* Stacks are defined in the stream ahead of the first event referencing them, like strings */
+  void defineStack(uint32_t id) {
+    if (!m_stackIds.insert(id).second)
+      return;
+    m_out.push_back(uint8_t(binlog::Tag::Stack));
+    putVarint(m_out, id);
+    putString(m_out, Stacks.rendered(id));
+  }
+
+  /* Returns false if any argument has no binary encoding (custom formatters, 128-bit, long double) */
+  bool encodeArgs(fmt::format_args args) {
+    m_args.clear();
+    m_argCount = 0;
+    bool encodable = true;
+    for (int i = 0; encodable; ++i) {
+      const auto arg = args.get(i);
+      if (!arg)
+        break;
+      fmt::visit_format_arg(
+          [&](auto val) {
+            using T = decltype(val);
+            if constexpr (std::is_same_v<T, bool>) {
+              m_args.push_back(uint8_t(binlog::ArgType::Bool));
+              m_args.push_back(uint8_t(val));
+            } else if constexpr (std::is_same_v<T, char>) {
+              m_args.push_back(uint8_t(binlog::ArgType::Char));
+              m_args.push_back(uint8_t(val));
+            } else if constexpr (std::is_same_v<T, int> || std::is_same_v<T, long long>) {
+              m_args.push_back(uint8_t(binlog::ArgType::Int));
+              putVarint(m_args, binlog::ZigZag(val));
+            } else if constexpr (std::is_same_v<T, unsigned> || std::is_same_v<T, unsigned long long>) {
+              m_args.push_back(uint8_t(binlog::ArgType::UInt));
+              putVarint(m_args, val);
+            } else if constexpr (std::is_same_v<T, float>) {
+              m_args.push_back(uint8_t(binlog::ArgType::Float));
+              putBytes(m_args, &val, sizeof(val));
+            } else if constexpr (std::is_same_v<T, double>) {
+              m_args.push_back(uint8_t(binlog::ArgType::Double));
+              putBytes(m_args, &val, sizeof(val));
+            } else if constexpr (std::is_same_v<T, const char*>) {
+              m_args.push_back(uint8_t(binlog::ArgType::String));
+              putString(m_args, val);
+            } else if constexpr (std::is_same_v<T, fmt::string_view>) {
+              m_args.push_back(uint8_t(binlog::ArgType::String));
+              putString(m_args, std::string_view(val.data(), val.size()));
+            } else if constexpr (std::is_same_v<T, const void*>) {
+              m_args.push_back(uint8_t(binlog::ArgType::Pointer));
+              putVarint(m_args, reinterpret_cast<uintptr_t>(val));
+            } else {
+              encodable = false;
+            }
+          },
+          arg);
+      ++m_argCount;
+    }
+    return encodable;
+  }
+
+  void reportRecord(const LogRecord& rec) override {
+    if (!openFileIfNeeded())
+      return;
+
+    fmt::string_view format = rec.format;
+    /* The format has no tags for fields, so structured records keep their rendered text */
+    const bool encodable = !rec.fieldCount && encodeArgs(rec.args);
+    if (!encodable) {
+      /* Store the rendered message as the sole argument of "{}" */
+      fmt::string_view message = rec.message();
+      if (rec.fieldCount) {
+        m_text.clear();
+        m_text.append(message.data(), message.data() + message.size());
+        detail::AppendFields(m_text, rec.fields, rec.fieldCount);
+        message = fmt::string_view(m_text.data(), m_text.size());
+      }
+      m_args.clear();
+      m_args.push_back(uint8_t(binlog::ArgType::String));
+      putString(m_args, std::string_view(message.data(), message.size()));
+      m_argCount = 1;
+      format = "{}";
+    }
+
+    /* Call sites resolve their strings once; records formatted eagerly for async delivery arrive as "{}" */
+    SiteIds ids;
+    if (rec.site && encodable && rec.format.data() == rec.site->format.data()) {
+      auto search = m_siteIds.find(rec.site);
+      if (search == m_siteIds.end())
+        search = m_siteIds.emplace(rec.site, SiteIds{intern(std::string_view(format.data(), format.size())),
+                                                     intern(rec.file)}).first;
+      ids = search->second;
+    } else {
+      ids.format = intern(std::string_view(format.data(), format.size()));
+      ids.file = rec.file ? intern(rec.file) : 0;
+    }
+    const uint64_t formatId = ids.format;
+    const uint64_t moduleId = intern(rec.modName);
+    const uint64_t threadId = rec.threadName ? intern(rec.threadName) : 0;
+    const uint64_t fileId = ids.file;
+    const MonoClock::rep ticks = rec.uptime.count();
+    if (rec.stackId)
+      defineStack(rec.stackId);
+
+    const bool sampled = rec.sampleRate < 1.0f;
+    m_out.push_back(uint8_t(binlog::Tag::Event));
+    m_out.push_back(uint8_t(rec.severity) | (sampled ? binlog::SampleRate : 0) |
+                    (rec.stackId ? binlog::Stack : 0));
+    putVarint(m_out, binlog::ZigZag(int64_t(ticks - m_lastTicks)));
+    m_lastTicks = ticks;
+    putVarint(m_out, rec.frameIndex);
+    putVarint(m_out, formatId);
+    putVarint(m_out, moduleId);
+    putVarint(m_out, threadId);
+    putVarint(m_out, fileId);
+    if (fileId)
+      putVarint(m_out, rec.linenum);
+    putVarint(m_out, m_argCount);
+    m_out.insert(m_out.end(), m_args.begin(), m_args.end());
+    if (sampled)
+      putBytes(m_out, &rec.sampleRate, sizeof(rec.sampleRate));
+    if (rec.stackId)
+      putVarint(m_out, rec.stackId);
+
+    std::fwrite(m_out.data(), 1, m_out.size(), m_fp);
+    countBytes(m_out.size());
+    m_out.clear();
+  }
+
+  const char* sinkName() const override { return "binary-file"; }
+};
+
+void RegisterBinaryFileLogger(const char* filepath) {
+  auto lk = LockLog();
+  AddMainLogger(new BinaryFileLogger(filepath));
+}
+
+/* Bounded multi-producer queue after Dmitry Vyukov's design; cells are filled and drained in place */
+template <typename T>
+class BoundedQueue {
+  struct Cell {
+    std::atomic_size_t sequence;
+    T data;
+  };
+  std::unique_ptr<Cell[]> m_cells;
+  size_t m_mask;
+  alignas(64) std::atomic_size_t m_enqueuePos{0};
+  alignas(64) std::atomic_size_t m_dequeuePos{0};
+
+public:
+  explicit BoundedQueue(size_t capacity) {
+    size_t size = 2;
+    while (size < capacity)
+      size <<= 1;
+    m_cells.reset(new Cell[size]);
+    for (size_t i = 0; i < size; ++i)
+      m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    m_mask = size - 1;
+  }
+
+  template <typename FillFunc>
+  bool tryPush(FillFunc&& fill) {
+    size_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+      cell = &m_cells[pos & m_mask];
+      const size_t seq = cell->sequence.load(std::memory_order_acquire);
+      const intptr_t dif = intptr_t(seq) - intptr_t(pos);
+      if (dif == 0) {
+        if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      } else if (dif < 0) {
+        return false;
+      } else {
+        pos = m_enqueuePos.load(std::memory_order_relaxed);
+      }
+    }
+    fill(cell->data);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  template <typename ConsumeFunc>
+  bool tryPop(ConsumeFunc&& consume) {
+    size_t pos = m_dequeuePos.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+      cell = &m_cells[pos & m_mask];
+      const size_t seq = cell->sequence.load(std::memory_order_acquire);
+      const intptr_t dif = intptr_t(seq) - intptr_t(pos + 1);
+      if (dif == 0) {
+        if (m_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+          break;
+      } else if (dif < 0) {
+        return false;
+      } else {
+        pos = m_dequeuePos.load(std::memory_order_relaxed);
+      }
+    }
+    consume(cell->data);
+    cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+    return true;
+  }
+
+  /* Number of cells claimed by producers so far */
+  size_t claimedCount() const { return m_enqueuePos.load(std::memory_order_acquire); }
+};
+
+static thread_local bool IsAsyncWriterThread = false;
+
+class AsyncLogger {
+  struct Slot {
+    const char* modName;
+    Level severity;
+    const char* file;
+    unsigned linenum;
+    const CallSite* site;
+    MonoClock::duration uptime;
+    uint64_t frameIndex;
+    const char* threadName;
+    CapturedStack stack;
+    float sampleRate;
+    /* Deferred reports: decodes the encoded arguments, nullptr if payload is preformatted text */
+    detail::DeferredDecodeFunc decode;
+    const char* format; /* Static format string, nullptr if copied to the front of payload */
+    size_t formatSize;
+    /* Structured reports: fields are encoded in payload after the message text */
+    uint32_t fieldCount;
+    size_t fieldsOffset;
+    std::string payload;
+  };
+
+  std::unique_ptr<BoundedQueue<Slot>> m_queue;
+  std::atomic_bool m_active{false};
+  std::atomic_bool m_stopping{false};
+  std::atomic_bool m_writerSleeping{false};
+  std::atomic_size_t m_published{0};
+  std::atomic_size_t m_delivered{0};
+  std::atomic_size_t m_flushWaiters{0};
+  std::thread m_writer;
+  std::mutex m_controlMutex;
+  fmt::memory_buffer m_formatBuf;
+  std::vector<Field> m_fieldBuf;
+
+  /* Backpressure, set by enable before m_active is published */
+  std::array<Backpressure, 3> m_policies{};
+  std::chrono::milliseconds m_blockTimeout{0};
+  std::string m_overflowPath;
+  std::mutex m_overflowMutex;
+  FILE* m_overflowFile = nullptr;
+  PrintedStacks m_overflowStacks;
+  bool m_overflowFailed = false;
+
+  /* Records lost to a full queue; lossEvents changes whenever one of the counts does */
+  std::atomic_uint64_t m_dropped[3]{};
+  std::atomic_uint64_t m_spilled{0};
+  std::atomic_uint64_t m_lossEvents{0};
+  /* Counts already reported in a gap marker, owned by the writer */
+  uint64_t m_reportedLossEvents = 0;
+  uint64_t m_reportedDropped[3]{};
+  uint64_t m_reportedSpilled = 0;
+
+  /* Preformatted text of a slot that was not deferred */
+  static fmt::string_view text(const Slot& slot) {
+    return fmt::string_view(slot.payload.data(), slot.fieldCount ? slot.fieldsOffset : slot.payload.size());
+  }
+
+  /*
+   * Calls use(format, args, message) with the slot's record. Deferred slots keep their call's
+   * format string and decoded arguments, valid only during the call; the message is rendered
+   * into buf. Other slots are delivered as "{}" and their text.
+   */
+  template <typename Use>
+  static void visit(const Slot& slot, fmt::memory_buffer& buf, Use&& use) {
+    if (!slot.decode) {
+      const fmt::string_view message = text(slot);
+      use(fmt::string_view("{}"), fmt::format_args(fmt::make_format_args(message)), message);
+      return;
+    }
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(slot.payload.data());
+    fmt::string_view format(slot.format, slot.formatSize);
+    if (!slot.format) {
+      format = fmt::string_view(slot.payload.data(), slot.formatSize);
+      src += slot.formatSize;
+    }
+    struct Context {
+      fmt::string_view format;
+      fmt::memory_buffer& buf;
+      Use& use;
+    } context{format, buf, use};
+    slot.decode(
+        src,
+        [](fmt::format_args args, void* ptr) {
+          auto& ctx = *static_cast<Context*>(ptr);
+          ctx.buf.clear();
+          fmt::vformat_to(std::back_inserter(ctx.buf), ctx.format, args);
+          ctx.use(ctx.format, args, fmt::string_view(ctx.buf.data(), ctx.buf.size()));
+        },
+        &context);
+  }
+
+  /*
+   * Field encoding: key size (u32), key, type (u8), then the 8-byte value or, for strings,
+   * size (u64) and bytes. Decoded fields point into the slot's payload.
+   */
+  static void EncodeFields(std::string& payload, const Field* fields, size_t count) {
+    const auto put = [&payload](const void* data, size_t size) {
+      payload.append(static_cast<const char*>(data), size);
+    };
+    for (size_t i = 0; i < count; ++i) {
+      const Field& field = fields[i];
+      const uint32_t keySize = uint32_t(field.key.size());
+      put(&keySize, sizeof(keySize));
+      put(field.key.data(), keySize);
+      payload.push_back(char(field.type));
+      if (field.type == Field::Type::String) {
+        const uint64_t size = field.value.str.size;
+        put(&size, sizeof(size));
+        put(field.value.str.data, size);
+      } else {
+        put(&field.value, sizeof(uint64_t));
+      }
+    }
+  }
+
+  static void DecodeFields(const Slot& slot, std::vector<Field>& fields) {
+    const char* src = slot.payload.data() + slot.fieldsOffset;
+    const auto get = [&src](void* data, size_t size) {
+      std::memcpy(data, src, size);
+      src += size;
+    };
+    fields.resize(slot.fieldCount);
+    for (Field& field : fields) {
+      uint32_t keySize;
+      get(&keySize, sizeof(keySize));
+      field.key = std::string_view(src, keySize);
+      src += keySize;
+      field.type = Field::Type(*src++);
+      if (field.type == Field::Type::String) {
+        uint64_t size;
+        get(&size, sizeof(size));
+        field.value.str = {src, size_t(size)};
+        src += size;
+      } else {
+        get(&field.value, sizeof(uint64_t));
+      }
+    }
+  }
+
+  void deliver(Slot& slot) {
+    visit(slot, m_formatBuf, [&](fmt::string_view format, fmt::format_args args, fmt::string_view message) {
+      auto lk = LockLogForDelivery();
+      ++_LogCounter;
+      LogRecord rec{slot.modName, slot.severity,   slot.file,
+                    slot.linenum, format,          args,
+                    slot.uptime,  slot.frameIndex, slot.threadName,
+                    slot.site,    message,         &m_formatBuf,
+                    slot.stack.id, slot.sampleRate};
+      if (slot.fieldCount) {
+        DecodeFields(slot, m_fieldBuf);
+        rec.fields = m_fieldBuf.data();
+        rec.fieldCount = m_fieldBuf.size();
+      }
+      DeliverRecord(rec);
+    });
+  }
+
+  void countDropped(Level severity) {
+    m_dropped[severity].fetch_add(1, std::memory_order_relaxed);
+    m_lossEvents.fetch_add(1);
+  }
+
+  /* Writes a record the queue had no room for to the overflow file, on the reporting thread */
+  void spill(const Slot& slot) {
+    static thread_local fmt::memory_buffer MessageBuf;
+    static thread_local fmt::memory_buffer LineBuf;
+    static thread_local std::vector<Field> FieldBuf;
+
+    std::lock_guard<std::mutex> lk(m_overflowMutex);
+    if (!m_overflowFile && !m_overflowFailed && !m_overflowPath.empty()) {
+      m_overflowFile = std::fopen(m_overflowPath.c_str(), "a");
+      m_overflowFailed = !m_overflowFile;
+    }
+    if (!m_overflowFile) {
+      countDropped(slot.severity);
+      return;
+    }
+    visit(slot, MessageBuf, [&](fmt::string_view format, fmt::format_args args, fmt::string_view message) {
+      LogRecord rec{slot.modName, slot.severity,   slot.file,
+                    slot.linenum, format,          args,
+                    slot.uptime,  slot.frameIndex, slot.threadName,
+                    slot.site,    message,         &MessageBuf,
+                    slot.stack.id, slot.sampleRate};
+      if (slot.fieldCount) {
+        DecodeFields(slot, FieldBuf);
+        rec.fields = FieldBuf.data();
+        rec.fieldCount = FieldBuf.size();
+      }
+      LineBuf.clear();
+      FileLogger::_formatLine(LineBuf, rec, m_overflowStacks);
+    });
+    std::fwrite(LineBuf.data(), 1, LineBuf.size(), m_overflowFile);
+    m_spilled.fetch_add(1, std::memory_order_relaxed);
+    m_lossEvents.fetch_add(1);
+  }
+
+  void deliverGapMarker(fmt::string_view message) {
+    auto lk = LockLogForDelivery();
+    ++_LogCounter;
+    const auto args = fmt::make_format_args(message);
+    const LogRecord rec{"logvisor",      Warning,           nullptr,
+                        0,               "{}",              args,
+                        CurrentUptime(), FrameIndex.load(), CurrentThreadName,
+                        nullptr,         message,           &m_formatBuf};
+    DeliverRecord(rec);
+  }
+
+  /* Reports records lost since the last marker, at the position in the stream where they went missing */
+  void reportGaps() {
+    const uint64_t lossEvents = m_lossEvents.load();
+    if (lossEvents == m_reportedLossEvents)
+      return;
+    m_reportedLossEvents = lossEvents;
+
+    uint64_t dropped[3];
+    for (int level = 0; level < 3; ++level) {
+      const uint64_t total = m_dropped[level].load(std::memory_order_relaxed);
+      dropped[level] = total - m_reportedDropped[level];
+      m_reportedDropped[level] = total;
+    }
+    const uint64_t spilledTotal = m_spilled.load(std::memory_order_relaxed);
+    const uint64_t spilled = spilledTotal - m_reportedSpilled;
+    m_reportedSpilled = spilledTotal;
+
+    fmt::memory_buffer markerBuf;
+    if (dropped[0] || dropped[1] || dropped[2]) {
+      fmt::format_to(std::back_inserter(markerBuf),
+                     FMT_STRING("log queue full: dropped {} records ({} Info, {} Warning, {} Error)"),
+                     dropped[0] + dropped[1] + dropped[2], dropped[0], dropped[1], dropped[2]);
+      deliverGapMarker(fmt::string_view(markerBuf.data(), markerBuf.size()));
+    }
+    if (spilled) {
+      markerBuf.clear();
+      fmt::format_to(std::back_inserter(markerBuf), FMT_STRING("log queue full: spilled {} records to {}"), spilled,
+                     m_overflowPath);
+      deliverGapMarker(fmt::string_view(markerBuf.data(), markerBuf.size()));
+    }
+  }
+
+  void retire() {
+    m_delivered.fetch_add(1);
+    if (m_flushWaiters.load())
+      m_delivered.notify_all();
+  }
+
+  bool deliverNext() {
+    reportGaps();
+    if (!m_queue->tryPop([this](Slot& slot) { deliver(slot); }))
+      return false;
+    retire();
+    return true;
+  }
+
+  void writerLoop() {
+    IsAsyncWriterThread = true;
+    for (;;) {
+      if (deliverNext())
+        continue;
+      /* Re-check after publishing the sleep intent so a concurrent push can't be missed */
+      const size_t seen = m_published.load();
+      m_writerSleeping.store(true);
+      if (deliverNext()) {
+        m_writerSleeping.store(false);
+        continue;
+      }
+      if (m_stopping.load() && m_delivered.load() >= m_queue->claimedCount())
+        break;
+      m_published.wait(seen);
+      m_writerSleeping.store(false);
+    }
+    m_writerSleeping.store(false);
+  }
+
+  /* Returns false only if logging went synchronous; records lost to backpressure count as handled */
+  template <typename FillFunc>
+  bool enqueue(Level severity, FillFunc&& fill) {
+    const Backpressure policy = m_policies[severity];
+    MonoClock::time_point deadline{};
+    while (!m_queue->tryPush(fill)) {
+      if (!m_active.load())
+        return false;
+      switch (policy) {
+      case Backpressure::Block:
+        break;
+      case Backpressure::BlockTimeout:
+        if (deadline == MonoClock::time_point{}) {
+          deadline = MonoClock::now() + m_blockTimeout;
+        } else if (MonoClock::now() >= deadline) {
+          countDropped(severity);
+          return true;
+        }
+        break;
+      case Backpressure::DropNewest:
+        countDropped(severity);
+        return true;
+      case Backpressure::DropOldest:
+        if (m_queue->tryPop([this](Slot& slot) { countDropped(slot.severity); }))
+          retire();
+        continue;
+      case Backpressure::Spill: {
+        Slot slot;
+        fill(slot);
+        spill(slot);
+        return true;
+      }
+      }
+      std::this_thread::yield();
+    }
+
+    m_published.fetch_add(1);
+    if (m_writerSleeping.load())
+      m_published.notify_one();
+    return true;
+  }
+
+public:
+  ~AsyncLogger() { disable(); }
+
+  void enable(const AsyncLoggingOptions& options) {
+    std::lock_guard<std::mutex> lk(m_controlMutex);
+    if (m_active.load())
+      return;
+    if (!m_queue)
+      m_queue = std::make_unique<BoundedQueue<Slot>>(options.capacity);
+    m_policies = options.policies;
+    m_blockTimeout = options.blockTimeout;
+    {
+      std::lock_guard<std::mutex> overflowLk(m_overflowMutex);
+      m_overflowPath = options.overflowPath ? options.overflowPath : "";
+      m_overflowFailed = false;
+    }
+    m_stopping.store(false);
+    m_writer = std::thread(&AsyncLogger::writerLoop, this);
+    m_active.store(true);
+    detail::DeferFormatting.store(options.deferFormatting);
+  }
+
+  void disable() {
+    std::lock_guard<std::mutex> lk(m_controlMutex);
+    if (!m_active.load())
+      return;
+    detail::DeferFormatting.store(false);
+    m_active.store(false);
+    m_stopping.store(true);
+    m_published.fetch_add(1);
+    m_published.notify_one();
+    m_writer.join();
+    /* Producers that raced with shutdown */
+    while (deliverNext()) {}
+    reportGaps();
+    std::lock_guard<std::mutex> overflowLk(m_overflowMutex);
+    if (m_overflowFile) {
+      std::fclose(m_overflowFile);
+      m_overflowFile = nullptr;
+      m_overflowStacks.clear();
+    }
+  }
+
+  void collectLosses(LogStats& stats) const {
+    for (int level = 0; level < 3; ++level)
+      stats.queueDropped[level] = m_dropped[level].load(std::memory_order_relaxed);
+    stats.queueSpilled = m_spilled.load(std::memory_order_relaxed);
+  }
+
+  bool active() const { return m_active.load(std::memory_order_acquire) && !IsAsyncWriterThread; }
+
+  bool report(const char* modName, Level severity, const char* file, unsigned linenum, const CallSite* site,
+              CapturedStack stack, fmt::string_view format, fmt::format_args args) {
+    if (!m_active.load(std::memory_order_acquire) || IsAsyncWriterThread)
+      return false;
+
+    /* Format outside the queue so cells are held only for the copy */
+    static thread_local fmt::memory_buffer FormatBuf;
+    FormatBuf.clear();
+    fmt::vformat_to(std::back_inserter(FormatBuf), format, args);
+
+    const MonoClock::duration uptime = CurrentUptime();
+    const uint64_t frameIndex = FrameIndex.load();
+    const auto fill = [&](Slot& slot) {
+      slot.modName = modName;
+      slot.severity = severity;
+      slot.file = file;
+      slot.linenum = linenum;
+      slot.site = site;
+      slot.uptime = uptime;
+      slot.frameIndex = frameIndex;
+      slot.threadName = CurrentThreadName;
+      slot.stack = stack;
+      slot.sampleRate = SampleRate(site);
+      slot.decode = nullptr;
+      slot.format = nullptr;
+      slot.formatSize = 0;
+      slot.fieldCount = 0;
+      slot.payload.assign(FormatBuf.data(), FormatBuf.size());
+    };
+    return enqueue(severity, fill);
+  }
+
+  bool reportFields(const char* modName, Level severity, const char* file, unsigned linenum, CapturedStack stack,
+                    fmt::string_view message, const Field* fields, size_t count) {
+    if (!m_active.load(std::memory_order_acquire) || IsAsyncWriterThread)
+      return false;
+
+    /* Keys and string values only live for the report call, so they are copied with the message */
+    static thread_local std::string PayloadBuf;
+    PayloadBuf.assign(message.data(), message.size());
+    EncodeFields(PayloadBuf, fields, count);
+
+    const MonoClock::duration uptime = CurrentUptime();
+    const uint64_t frameIndex = FrameIndex.load();
+    const auto fill = [&](Slot& slot) {
+      slot.modName = modName;
+      slot.severity = severity;
+      slot.file = file;
+      slot.linenum = linenum;
+      slot.site = nullptr;
+      slot.uptime = uptime;
+      slot.frameIndex = frameIndex;
+      slot.threadName = CurrentThreadName;
+      slot.stack = stack;
+      slot.sampleRate = 1.0f;
+      slot.decode = nullptr;
+      slot.format = nullptr;
+      slot.formatSize = 0;
+      slot.fieldCount = uint32_t(count);
+      slot.fieldsOffset = message.size();
+      slot.payload.assign(PayloadBuf);
+    };
+    return enqueue(severity, fill);
+  }
+
+  bool deferReport(const char* modName, Level severity, const char* file, unsigned linenum, const CallSite* site,
+                   CapturedStack stack, fmt::string_view format, bool formatIsStatic, size_t argsSize, detail::DeferredEncodeFunc encode,
+                   const void* args, detail::DeferredDecodeFunc decode) {
+    if (!m_active.load(std::memory_order_acquire) || IsAsyncWriterThread)
+      return false;
+
+    const MonoClock::duration uptime = CurrentUptime();
+    const uint64_t frameIndex = FrameIndex.load();
+    const auto fill = [&](Slot& slot) {
+      slot.modName = modName;
+      slot.severity = severity;
+      slot.file = file;
+      slot.linenum = linenum;
+      slot.site = site;
+      slot.uptime = uptime;
+      slot.frameIndex = frameIndex;
+      slot.threadName = CurrentThreadName;
+      slot.stack = stack;
+      slot.sampleRate = SampleRate(site);
+      slot.decode = decode;
+      slot.format = formatIsStatic ? format.data() : nullptr;
+      slot.formatSize = format.size();
+      slot.fieldCount = 0;
+      const size_t formatCopySize = formatIsStatic ? 0 : format.size();
+      slot.payload.resize(formatCopySize + argsSize);
+      char* dst = slot.payload.data();
+      std::memcpy(dst, format.data(), formatCopySize);
+      encode(reinterpret_cast<uint8_t*>(dst + formatCopySize), args);
+    };
+    return enqueue(severity, fill);
+  }
+
+  void flush() {
+    if (!m_active.load() || IsAsyncWriterThread)
+      return;
+    const size_t target = m_queue->claimedCount();
+    m_flushWaiters.fetch_add(1);
+    for (size_t delivered = m_delivered.load(); delivered < target; delivered = m_delivered.load())
+      m_delivered.wait(delivered);
+    m_flushWaiters.fetch_sub(1);
+  }
+
+  /* Bounded wait used on the fatal path, where the writer may itself be wedged */
+  void drainForAbort() {
+    if (!m_active.load() || IsAsyncWriterThread)
+      return;
+    const size_t target = m_queue->claimedCount();
+    const auto deadline = MonoClock::now() + std::chrono::seconds(2);
+    while (m_delivered.load() < target && MonoClock::now() < deadline)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+};
+
+static AsyncLogger AsyncFrontend;
+std::atomic_bool detail::DeferFormatting{false};
+
+void EnableAsyncLogging(size_t capacity, bool deferFormatting) {
+  AsyncLoggingOptions options;
+  options.capacity = capacity;
+  options.deferFormatting = deferFormatting;
+  AsyncFrontend.enable(options);
+}
+
+void EnableAsyncLogging(const AsyncLoggingOptions& options) { AsyncFrontend.enable(options); }
+
+void DisableAsyncLogging() { AsyncFrontend.disable(); }
+
+void FlushLog() { AsyncFrontend.flush(); }
+
+static void CollectQueueLosses(LogStats& stats) { AsyncFrontend.collectLosses(stats); }
+
+/* Error accounting for events handed to the writer thread */
+static void QueuedReportAccounting(Level severity) {
+  if (severity == Error) {
+    logvisorBp();
+    ++ErrorCount;
+  }
+}
+
+/* Error accounting for events delivered on the reporting thread, with the log lock held */
+static void DeliveredReportAccounting(Level severity) {
+  if (severity == Error || severity == Fatal)
+    logvisorBp();
+  if (severity == Fatal)
+    logvisorAbort();
+  else if (severity == Error)
+    ++ErrorCount;
+}
+
+bool detail::DeferReport(const char* modName, Level severity, const char* file, unsigned linenum,
+                         const CallSite* site, fmt::string_view format, bool formatIsStatic, size_t argsSize,
+                         DeferredEncodeFunc encode, const void* args, DeferredDecodeFunc decode) {
+  if (!AsyncFrontend.active())
+    return false;
+  if (!AsyncFrontend.deferReport(modName, severity, file, linenum, site, CaptureReportStack(severity), format,
+                                 formatIsStatic, argsSize, encode, args, decode))
+    return false;
+  QueuedReportAccounting(severity);
+  return true;
+}
+
+/* Rate limiter summaries pass countError = false: the errors they stand for were counted as they were dropped */
+static LOGVISOR_ALWAYS_INLINE void DispatchReport(const char* modName, Level severity, const char* file,
+                                                  unsigned linenum, const CallSite* site, fmt::string_view format,
+                                                  fmt::format_args args, bool countError) {
+  const CapturedStack stack = CaptureReportStack(severity);
+  if (severity != Fatal && AsyncFrontend.report(modName, severity, file, linenum, site, stack, format, args)) {
+    if (countError)
+      QueuedReportAccounting(severity);
+    return;
+  }
+
+  if (severity == Fatal)
+    AsyncFrontend.drainForAbort();
+
+  auto lk = LockLogForDelivery();
+  ++_LogCounter;
+  if (severity == Fatal)
+    RegisterConsoleLogger();
+  MessageBuffer messageBuf;
+  const LogRecord rec = CaptureRecord(modName, severity, file, linenum, site, format, args, messageBuf.get(), stack);
+  DeliverRecord(rec);
+  if (countError || severity == Fatal)
+    DeliveredReportAccounting(severity);
+}
+
+void _DispatchReport(const char* modName, Level severity, const char* file, unsigned linenum, const CallSite* site,
+                     fmt::string_view format, fmt::format_args args) {
+  DispatchReport(modName, severity, file, linenum, site, format, args, true);
+}
+
+void _DispatchFields(const char* modName, Level severity, const char* file, unsigned linenum, fmt::string_view message,
+                     const Field* fields, size_t count) {
+  const CapturedStack stack = CaptureReportStack(severity);
+  if (severity != Fatal && AsyncFrontend.reportFields(modName, severity, file, linenum, stack, message, fields, count)) {
+    QueuedReportAccounting(severity);
+    return;
+  }
+
+  if (severity == Fatal)
+    AsyncFrontend.drainForAbort();
+
+  auto lk = LockLogForDelivery();
+  ++_LogCounter;
+  if (severity == Fatal)
+    RegisterConsoleLogger();
+  MessageBuffer messageBuf;
+  const auto args = fmt::make_format_args(message);
+  LogRecord rec = CaptureRecord(modName, severity, file, linenum, nullptr, "{}", args, messageBuf.get(), stack);
+  rec.renderedMessage = message;
+  rec.fields = fields;
+  rec.fieldCount = count;
+  DeliverRecord(rec);
+  DeliveredReportAccounting(severity);
+}
+
+uint64_t detail::SeedRandom() {
+  const uint64_t seed = uint64_t(std::hash<std::thread::id>()(std::this_thread::get_id())) ^
+                        uint64_t(MonoClock::now().time_since_epoch().count()) * 0x9e3779b97f4a7c15;
+  /* xorshift state must be nonzero */
+  return seed ? seed : 1;
+}
+
+/* Limiters that have dropped messages at least once, for ReportSuppressedMessages */
+static std::atomic<RateLimiter*> SuppressingLimiters{nullptr};
+
+static inline int64_t SteadyNanos() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(MonoClock::now().time_since_epoch()).count();
+}
+
+void RateLimiter::_reportSuppressed(const Module& module, Level severity, const char* file, unsigned linenum,
+                                    const CallSite* site) {
+  const uint64_t count = m_suppressed.exchange(0, std::memory_order_relaxed);
+  if (!count)
+    return;
+  const auto args = fmt::make_format_args(count);
+  DispatchReport(module.name(), severity, file, linenum, site, "suppressed {} similar messages", args, false);
+}
+
+/* Reports the drop count once summaryInterval has passed since the last summary; one caller wins the race */
+void RateLimiter::_summarize(const Module& module, Level severity, const char* file, unsigned linenum,
+                             const CallSite* site, int64_t now) {
+  int64_t lastSummary = m_lastSummary.load(std::memory_order_relaxed);
+  if (now - lastSummary >= std::chrono::nanoseconds(m_limit.summaryInterval).count() &&
+      m_lastSummary.compare_exchange_strong(lastSummary, now, std::memory_order_relaxed))
+    _reportSuppressed(module, severity, file, linenum, site);
+}
+
+bool RateLimiter::admit(const Module& module, Level severity, const char* file, unsigned linenum,
+                        const CallSite* site, uint64_t argsHash) {
+  const int64_t now = SteadyNanos();
+  const int64_t duplicateWindow = std::chrono::nanoseconds(m_limit.duplicateWindow).count();
+  bool drop = argsHash && duplicateWindow > 0 && m_lastHash.load(std::memory_order_relaxed) == argsHash &&
+              now - m_lastAdmitted.load(std::memory_order_relaxed) < duplicateWindow;
+
+  if (!drop && m_limit.perSecond > 0.0) {
+    /* Each message pushes the arrival time out by one interval; up to burst may be ahead of now */
+    const auto interval = int64_t(1e9 / m_limit.perSecond);
+    const int64_t tolerance = interval * int64_t(std::max(m_limit.burst, 1u) - 1);
+    int64_t arrival = m_nextArrival.load(std::memory_order_relaxed);
+    for (;;) {
+      const int64_t start = std::max(arrival, now);
+      if (start - now > tolerance) {
+        drop = true;
+        break;
+      }
+      if (m_nextArrival.compare_exchange_weak(arrival, start + interval, std::memory_order_relaxed))
+        break;
+    }
+  }
+
+  if (drop) {
+    /* ErrorCount counts reported errors, whether or not they were logged */
+    if (severity == Error && module.enabled(severity))
+      ++ErrorCount;
+    if (!m_registered.exchange(true, std::memory_order_relaxed)) {
+      m_module = &module;
+      m_severity = severity;
+      m_file = file;
+      m_linenum = linenum;
+      m_site = site;
+      m_next = SuppressingLimiters.load(std::memory_order_relaxed);
+      while (!SuppressingLimiters.compare_exchange_weak(m_next, this, std::memory_order_release,
+                                                        std::memory_order_relaxed)) {}
+    }
+    /* The summary interval runs from the first drop */
+    if (m_suppressed.fetch_add(1, std::memory_order_relaxed) == 0)
+      m_lastSummary.store(now, std::memory_order_relaxed);
+    else
+      _summarize(module, severity, file, linenum, site, now);
+    return false;
+  }
+
+  m_lastHash.store(argsHash, std::memory_order_relaxed);
+  m_lastAdmitted.store(now, std::memory_order_relaxed);
+  if (m_suppressed.load(std::memory_order_relaxed))
+    _summarize(module, severity, file, linenum, site, now);
+  return true;
+}
+
+void ReportSuppressedMessages() {
+  const int64_t now = SteadyNanos();
+  for (RateLimiter* limiter = SuppressingLimiters.load(std::memory_order_acquire); limiter;
+       limiter = limiter->m_next) {
+    if (!limiter->m_suppressed.load(std::memory_order_relaxed) || !limiter->m_module->enabled(limiter->m_severity))
+      continue;
+    limiter->m_lastSummary.store(now, std::memory_order_relaxed);
+    limiter->_reportSuppressed(*limiter->m_module, limiter->m_severity, limiter->m_file, limiter->m_linenum,
+                               limiter->m_site);
+  }
 }
 
 } // namespace logvisor
@@ -0,0 +1,167 @@
+#pragma once
+
+/*
+ * Minimal io_uring wrapper for the io_uring file logger. Talks to the kernel through the raw
+ * system calls, so liburing is not required. Single issuer: all members must be called with the
+ * log lock held.
+ */
+
+#if __linux__ && __has_include(<linux/io_uring.h>)
+#define LOGVISOR_HAS_IO_URING 1
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+namespace logvisor::uring {
+
+class Ring {
+  int m_fd = -1;
+  void* m_sqMap = MAP_FAILED;
+  size_t m_sqMapSize = 0;
+  void* m_cqMap = MAP_FAILED;
+  size_t m_cqMapSize = 0;
+  io_uring_sqe* m_sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+  size_t m_sqesSize = 0;
+
+  unsigned* m_sqHead = nullptr;
+  unsigned* m_sqTail = nullptr;
+  unsigned* m_sqArray = nullptr;
+  unsigned m_sqMask = 0;
+  unsigned m_sqEntries = 0;
+  unsigned* m_cqHead = nullptr;
+  unsigned* m_cqTail = nullptr;
+  io_uring_cqe* m_cqes = nullptr;
+  unsigned m_cqMask = 0;
+  unsigned m_localTail = 0;
+
+  static unsigned load(unsigned* p) { return std::atomic_ref<unsigned>(*p).load(std::memory_order_acquire); }
+  static void store(unsigned* p, unsigned v) { std::atomic_ref<unsigned>(*p).store(v, std::memory_order_release); }
+
+  static void* field(void* map, uint32_t offset) { return static_cast<char*>(map) + offset; }
+
+  int enter(unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    return int(syscall(__NR_io_uring_enter, m_fd, toSubmit, minComplete, flags, nullptr, 0));
+  }
+
+public:
+  Ring() = default;
+  Ring(const Ring&) = delete;
+  Ring& operator=(const Ring&) = delete;
+
+  ~Ring() {
+    if (m_sqes != MAP_FAILED)
+      munmap(m_sqes, m_sqesSize);
+    if (m_cqMap != MAP_FAILED && m_cqMap != m_sqMap)
+      munmap(m_cqMap, m_cqMapSize);
+    if (m_sqMap != MAP_FAILED)
+      munmap(m_sqMap, m_sqMapSize);
+    if (m_fd >= 0)
+      close(m_fd);
+  }
+
+  /* Returns false if the kernel lacks io_uring or it is blocked (e.g. by seccomp) */
+  bool init(unsigned entries) {
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    m_fd = int(syscall(__NR_io_uring_setup, entries, &params));
+    if (m_fd < 0)
+      return false;
+
+    m_sqMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (singleMap)
+      m_sqMapSize = m_cqMapSize = std::max(m_sqMapSize, m_cqMapSize);
+    m_sqMap = mmap(nullptr, m_sqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+    if (m_sqMap == MAP_FAILED)
+      return false;
+    m_cqMap = singleMap ? m_sqMap
+                        : mmap(nullptr, m_cqMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+                               IORING_OFF_CQ_RING);
+    if (m_cqMap == MAP_FAILED)
+      return false;
+    m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = static_cast<io_uring_sqe*>(
+        mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES));
+    if (m_sqes == MAP_FAILED)
+      return false;
+
+    m_sqHead = static_cast<unsigned*>(field(m_sqMap, params.sq_off.head));
+    m_sqTail = static_cast<unsigned*>(field(m_sqMap, params.sq_off.tail));
+    m_sqArray = static_cast<unsigned*>(field(m_sqMap, params.sq_off.array));
+    m_sqMask = *static_cast<unsigned*>(field(m_sqMap, params.sq_off.ring_mask));
+    m_sqEntries = params.sq_entries;
+    m_localTail = *m_sqTail;
+    m_cqHead = static_cast<unsigned*>(field(m_cqMap, params.cq_off.head));
+    m_cqTail = static_cast<unsigned*>(field(m_cqMap, params.cq_off.tail));
+    m_cqes = static_cast<io_uring_cqe*>(field(m_cqMap, params.cq_off.cqes));
+    m_cqMask = *static_cast<unsigned*>(field(m_cqMap, params.cq_off.ring_mask));
+    return true;
+  }
+
+  bool registerBuffers(const iovec* iovs, unsigned count) {
+    return syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_BUFFERS, iovs, count) == 0;
+  }
+
+  /* Queues a write; bufIndex selects a registered buffer, or -1 for a plain write */
+  bool prepWrite(int fd, const void* data, unsigned size, uint64_t offset, int bufIndex, uint64_t userData) {
+    const unsigned tail = m_localTail;
+    if (tail - load(m_sqHead) >= m_sqEntries)
+      return false;
+    io_uring_sqe* sqe = &m_sqes[tail & m_sqMask];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = bufIndex >= 0 ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->off = offset;
+    sqe->addr = reinterpret_cast<uintptr_t>(data);
+    sqe->len = size;
+    sqe->buf_index = uint16_t(bufIndex >= 0 ? bufIndex : 0);
+    sqe->user_data = userData;
+    m_sqArray[tail & m_sqMask] = tail & m_sqMask;
+    ++m_localTail;
+    return true;
+  }
+
+  /*
+   * Hands every queued write the kernel has not consumed yet to it in one call, optionally waiting
+   * for a completion. Writes left over by a failed call are retried by the next one.
+   */
+  bool submit(unsigned waitFor = 0) {
+    store(m_sqTail, m_localTail);
+    const unsigned toSubmit = m_localTail - load(m_sqHead);
+    if (!toSubmit && !waitFor)
+      return true;
+    int ret;
+    do {
+      ret = enter(toSubmit, waitFor, waitFor ? IORING_ENTER_GETEVENTS : 0);
+    } while (ret < 0 && errno == EINTR);
+    return ret >= 0;
+  }
+
+  /* Consumes available completions without blocking */
+  template <typename Func>
+  unsigned reap(Func&& func) {
+    unsigned head = *m_cqHead;
+    const unsigned tail = load(m_cqTail);
+    const unsigned count = tail - head;
+    for (; head != tail; ++head) {
+      const io_uring_cqe& cqe = m_cqes[head & m_cqMask];
+      func(cqe.user_data, cqe.res);
+    }
+    store(m_cqHead, head);
+    return count;
+  }
+};
+
+} // namespace logvisor::uring
+
+#endif
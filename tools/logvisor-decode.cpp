@@ -0,0 +1,428 @@
+/*
+ * logvisor-decode: convert a RegisterBinaryFileLogger stream to text or JSON
+ *
+ * Usage: logvisor-decode [--json] <input> [output]
+ *
+ * Text output is identical to what the FileLogger would have written for the same events; like
+ * the FileLogger, a stack's frames are printed with its first reference after each open.
+ * JSON output has one object per line.
+ */
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <fmt/args.h>
+#include <fmt/format.h>
+
+#include "binlog.hpp"
+
+using namespace logvisor;
+
+namespace {
+
+constexpr const char* LevelNames[] = {"INFO", "WARNING", "ERROR", "FATAL ERROR"};
+
+class Reader {
+  FILE* m_fp;
+  std::vector<uint8_t> m_buf = std::vector<uint8_t>(65536);
+  size_t m_pos = 0;
+  size_t m_size = 0;
+
+  bool fill() {
+    if (m_pos != m_size)
+      return true;
+    m_pos = 0;
+    m_size = std::fread(m_buf.data(), 1, m_buf.size(), m_fp);
+    return m_size != 0;
+  }
+
+public:
+  explicit Reader(FILE* fp) : m_fp(fp) {}
+
+  bool peek(uint8_t& byte) {
+    if (!fill())
+      return false;
+    byte = m_buf[m_pos];
+    return true;
+  }
+
+  bool byte(uint8_t& byte) {
+    if (!peek(byte))
+      return false;
+    ++m_pos;
+    return true;
+  }
+
+  bool bytes(void* dst, size_t size) {
+    auto* out = static_cast<uint8_t*>(dst);
+    while (size) {
+      if (!fill())
+        return false;
+      const size_t chunk = std::min(size, m_size - m_pos);
+      std::memcpy(out, m_buf.data() + m_pos, chunk);
+      m_pos += chunk;
+      out += chunk;
+      size -= chunk;
+    }
+    return true;
+  }
+
+  bool varint(uint64_t& val) {
+    val = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+      uint8_t b;
+      if (!byte(b))
+        return false;
+      val |= uint64_t(b & 0x7f) << shift;
+      if (!(b & 0x80))
+        return true;
+    }
+    return false;
+  }
+
+  bool string(std::string& str) {
+    uint64_t len;
+    if (!varint(len))
+      return false;
+    str.resize(len);
+    return bytes(str.data(), len);
+  }
+};
+
+struct Session {
+  uint64_t clockNum = 1;
+  uint64_t clockDen = 1;
+  int64_t ticks = 0;
+  std::vector<std::string> strings;
+  struct Stack {
+    std::string frames;
+    bool referenced = false;
+  };
+  std::unordered_map<uint64_t, Stack> stacks;
+
+  const char* lookup(uint64_t id) const {
+    if (id == 0 || id > strings.size())
+      return nullptr;
+    return strings[id - 1].c_str();
+  }
+};
+
+struct Event {
+  uint8_t level = 0;
+  double seconds = 0.0;
+  uint64_t frameIndex = 0;
+  const char* format = nullptr;
+  const char* modName = nullptr;
+  const char* threadName = nullptr;
+  const char* file = nullptr;
+  uint64_t linenum = 0;
+  float sampleRate = 1.0f;
+  uint64_t stackId = 0;
+  const std::string* stackFrames = nullptr; /* Set on the stack's first reference in the session */
+  std::string message;
+};
+
+/* Mirrors FileLogger::_formatLine */
+void WriteText(FILE* out, const Event& ev) {
+  std::fputc('[', out);
+  std::fprintf(out, "%5.4f ", ev.seconds);
+  if (ev.frameIndex != 0)
+    std::fprintf(out, "(%" PRIu64 ") ", ev.frameIndex);
+  std::fputs(LevelNames[ev.level], out);
+  std::fprintf(out, " %s", ev.modName);
+  if (ev.file)
+    std::fprintf(out, " {%s:%" PRIu64 "}", ev.file, ev.linenum);
+  if (ev.threadName)
+    std::fprintf(out, " (%s)", ev.threadName);
+  std::fputs("] ", out);
+  std::fwrite(ev.message.data(), 1, ev.message.size(), out);
+  if (ev.sampleRate < 1.0f)
+    fmt::print(out, FMT_STRING(" (sampled 1/{:g})"), 1.0f / ev.sampleRate);
+  if (ev.stackId) {
+    std::fprintf(out, " (stack %" PRIu64 ")", ev.stackId);
+    if (ev.stackFrames) {
+      std::fputc('\n', out);
+      std::fwrite(ev.stackFrames->data(), 1, ev.stackFrames->empty() ? 0 : ev.stackFrames->size() - 1, out);
+    }
+  }
+  std::fputc('\n', out);
+}
+
+void WriteJsonString(FILE* out, const char* str) {
+  if (!str) {
+    std::fputs("null", out);
+    return;
+  }
+  std::fputc('"', out);
+  for (; *str; ++str) {
+    const auto ch = static_cast<unsigned char>(*str);
+    switch (ch) {
+    case '"':
+      std::fputs("\\\"", out);
+      break;
+    case '\\':
+      std::fputs("\\\\", out);
+      break;
+    case '\n':
+      std::fputs("\\n", out);
+      break;
+    case '\r':
+      std::fputs("\\r", out);
+      break;
+    case '\t':
+      std::fputs("\\t", out);
+      break;
+    default:
+      if (ch < 0x20)
+        std::fprintf(out, "\\u%04x", ch);
+      else
+        std::fputc(ch, out);
+      break;
+    }
+  }
+  std::fputc('"', out);
+}
+
+void WriteJson(FILE* out, const Event& ev) {
+  std::fprintf(out, "{\"time\":%.9f,\"frame\":%" PRIu64 ",\"level\":", ev.seconds, ev.frameIndex);
+  WriteJsonString(out, LevelNames[ev.level]);
+  std::fputs(",\"module\":", out);
+  WriteJsonString(out, ev.modName);
+  std::fputs(",\"thread\":", out);
+  WriteJsonString(out, ev.threadName);
+  if (ev.file) {
+    std::fputs(",\"file\":", out);
+    WriteJsonString(out, ev.file);
+    std::fprintf(out, ",\"line\":%" PRIu64, ev.linenum);
+  }
+  if (ev.sampleRate < 1.0f)
+    fmt::print(out, FMT_STRING(",\"sample_rate\":{}"), ev.sampleRate);
+  if (ev.stackId) {
+    std::fprintf(out, ",\"stack\":%" PRIu64, ev.stackId);
+    if (ev.stackFrames) {
+      std::fputs(",\"frames\":", out);
+      WriteJsonString(out, ev.stackFrames->c_str());
+    }
+  }
+  std::fputs(",\"message\":", out);
+  WriteJsonString(out, ev.message.c_str());
+  std::fputs("}\n", out);
+}
+
+bool ReadArgs(Reader& in, fmt::dynamic_format_arg_store<fmt::format_context>& store) {
+  uint64_t count;
+  if (!in.varint(count))
+    return false;
+  for (uint64_t i = 0; i < count; ++i) {
+    uint8_t type;
+    if (!in.byte(type))
+      return false;
+    switch (binlog::ArgType(type)) {
+    case binlog::ArgType::Int: {
+      uint64_t val;
+      if (!in.varint(val))
+        return false;
+      store.push_back(static_cast<long long>(binlog::UnZigZag(val)));
+      break;
+    }
+    case binlog::ArgType::UInt: {
+      uint64_t val;
+      if (!in.varint(val))
+        return false;
+      store.push_back(static_cast<unsigned long long>(val));
+      break;
+    }
+    case binlog::ArgType::Bool: {
+      uint8_t val;
+      if (!in.byte(val))
+        return false;
+      store.push_back(val != 0);
+      break;
+    }
+    case binlog::ArgType::Char: {
+      uint8_t val;
+      if (!in.byte(val))
+        return false;
+      store.push_back(static_cast<char>(val));
+      break;
+    }
+    case binlog::ArgType::Float: {
+      float val;
+      if (!in.bytes(&val, sizeof(val)))
+        return false;
+      store.push_back(val);
+      break;
+    }
+    case binlog::ArgType::Double: {
+      double val;
+      if (!in.bytes(&val, sizeof(val)))
+        return false;
+      store.push_back(val);
+      break;
+    }
+    case binlog::ArgType::String: {
+      std::string val;
+      if (!in.string(val))
+        return false;
+      store.push_back(std::move(val));
+      break;
+    }
+    case binlog::ArgType::Pointer: {
+      uint64_t val;
+      if (!in.varint(val))
+        return false;
+      store.push_back(reinterpret_cast<const void*>(uintptr_t(val)));
+      break;
+    }
+    default:
+      return false;
+    }
+  }
+  return true;
+}
+
+bool ReadEvent(Reader& in, Session& session, Event& ev) {
+  uint8_t flags;
+  uint64_t tickDelta, formatId, moduleId, threadId, fileId;
+  if (!in.byte(flags) || (flags & binlog::LevelMask) > 3 || !in.varint(tickDelta) || !in.varint(ev.frameIndex) ||
+      !in.varint(formatId) || !in.varint(moduleId) || !in.varint(threadId) || !in.varint(fileId))
+    return false;
+  ev.level = flags & binlog::LevelMask;
+  ev.linenum = 0;
+  if (fileId && !in.varint(ev.linenum))
+    return false;
+
+  session.ticks += binlog::UnZigZag(tickDelta);
+  ev.seconds = session.ticks * int64_t(session.clockNum) / static_cast<double>(session.clockDen);
+  ev.format = session.lookup(formatId);
+  ev.modName = session.lookup(moduleId);
+  ev.threadName = session.lookup(threadId);
+  ev.file = session.lookup(fileId);
+  if (!ev.format || !ev.modName)
+    return false;
+
+  fmt::dynamic_format_arg_store<fmt::format_context> store;
+  if (!ReadArgs(in, store))
+    return false;
+  ev.message = fmt::vformat(fmt::string_view(ev.format), store);
+  ev.sampleRate = 1.0f;
+  if ((flags & binlog::SampleRate) && !in.bytes(&ev.sampleRate, sizeof(ev.sampleRate)))
+    return false;
+  ev.stackId = 0;
+  ev.stackFrames = nullptr;
+  if (flags & binlog::Stack) {
+    if (!in.varint(ev.stackId))
+      return false;
+    auto search = session.stacks.find(ev.stackId);
+    if (search == session.stacks.end())
+      return false;
+    if (!search->second.referenced) {
+      search->second.referenced = true;
+      ev.stackFrames = &search->second.frames;
+    }
+  }
+  return true;
+}
+
+bool ReadSessionHeader(Reader& in, Session& session) {
+  char magic[sizeof(binlog::SessionMagic)];
+  if (!in.bytes(magic, sizeof(magic)) || std::memcmp(magic, binlog::SessionMagic, sizeof(magic)) != 0)
+    return false;
+  session = Session();
+  return in.varint(session.clockNum) && in.varint(session.clockDen) && session.clockDen != 0;
+}
+
+int Decode(Reader& in, FILE* out, bool json) {
+  Session session;
+  if (!ReadSessionHeader(in, session)) {
+    std::fputs("logvisor-decode: not a logvisor binary log\n", stderr);
+    return 1;
+  }
+
+  Event ev;
+  uint8_t tag;
+  bool valid = true;
+  while (valid && in.peek(tag)) {
+    if (tag == uint8_t(binlog::SessionMagic[0])) {
+      /* Logger reopened the file and appended a new session */
+      valid = ReadSessionHeader(in, session);
+      continue;
+    }
+    in.byte(tag);
+    if (tag == uint8_t(binlog::Tag::String)) {
+      uint64_t id;
+      std::string str;
+      valid = in.varint(id) && id == session.strings.size() + 1 && in.string(str);
+      if (valid)
+        session.strings.push_back(std::move(str));
+    } else if (tag == uint8_t(binlog::Tag::Stack)) {
+      uint64_t id;
+      std::string frames;
+      valid = in.varint(id) && id != 0 && in.string(frames) &&
+              session.stacks.try_emplace(id, Session::Stack{std::move(frames)}).second;
+    } else if (tag == uint8_t(binlog::Tag::Event)) {
+      valid = ReadEvent(in, session, ev);
+      if (valid) {
+        if (json)
+          WriteJson(out, ev);
+        else
+          WriteText(out, ev);
+      }
+    } else {
+      valid = false;
+    }
+  }
+
+  if (!valid) {
+    std::fputs("logvisor-decode: stopped at truncated or corrupt record\n", stderr);
+    return 1;
+  }
+  return 0;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+  bool json = false;
+  bool badArgs = false;
+  const char* inPath = nullptr;
+  const char* outPath = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "--json"))
+      json = true;
+    else if (!inPath)
+      inPath = argv[i];
+    else if (!outPath)
+      outPath = argv[i];
+    else
+      badArgs = true;
+  }
+  if (!inPath || badArgs) {
+    std::fputs("Usage: logvisor-decode [--json] <input> [output]\n", stderr);
+    return 2;
+  }
+
+  FILE* in = std::fopen(inPath, "rb");
+  if (!in) {
+    std::fprintf(stderr, "logvisor-decode: unable to open %s\n", inPath);
+    return 1;
+  }
+  FILE* out = outPath ? std::fopen(outPath, "w") : stdout;
+  if (!out) {
+    std::fprintf(stderr, "logvisor-decode: unable to open %s\n", outPath);
+    std::fclose(in);
+    return 1;
+  }
+
+  Reader reader(in);
+  const int ret = Decode(reader, out, json);
+  std::fclose(in);
+  if (out != stdout)
+    std::fclose(out);
+  return ret;
+}
@@ -0,0 +1,208 @@
+/*
+ * logvisor-symbolize: resolve backtraces printed with EnableDeferredSymbolization
+ *
+ * Usage: logvisor-symbolize [-d <dir>]... [input] [output]
+ *
+ * Copies the input through, replacing each logvisor-frame line with the function it falls in.
+ * Every module is looked up by build ID, first as <dir>/.build-id/xx/rest.debug and then as
+ * <dir>/<file name> in each -d directory, then at the path recorded in the crashing process,
+ * then under /usr/lib/debug. A candidate is only used if its build ID matches, so stripped
+ * binaries can be resolved against the unstripped files they were produced from.
+ */
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <cxxabi.h>
+
+#include "elfsym.hpp"
+
+#if LOGVISOR_HAS_ELF
+
+using namespace logvisor;
+
+namespace {
+
+constexpr const char* ModuleTag = "logvisor-module ";
+constexpr const char* FrameTag = "logvisor-frame ";
+
+struct Module {
+  uint64_t base = 0;
+  std::string buildId;
+  std::string path;
+  std::string name;
+  std::unique_ptr<elf::Image> image;
+  bool searched = false;
+};
+
+class Resolver {
+  std::vector<std::string> m_dirs;
+  std::map<uint64_t, Module> m_modules;
+
+  std::unique_ptr<elf::Image> open(const std::string& path, const std::string& buildId) const {
+    auto image = std::make_unique<elf::Image>(path.c_str());
+    if (!image->hasSymbols() || (buildId != "-" && image->buildId() != buildId))
+      return {};
+    return image;
+  }
+
+  void locate(Module& mod) const {
+    mod.searched = true;
+    std::vector<std::string> candidates;
+    const std::string buildIdPath =
+        mod.buildId.size() > 2 ? "/.build-id/" + mod.buildId.substr(0, 2) + '/' + mod.buildId.substr(2) + ".debug"
+                               : std::string();
+    for (const auto& dir : m_dirs) {
+      if (!buildIdPath.empty())
+        candidates.push_back(dir + buildIdPath);
+      candidates.push_back(dir + '/' + mod.name);
+    }
+    candidates.push_back(mod.path);
+    if (!buildIdPath.empty())
+      candidates.push_back("/usr/lib/debug" + buildIdPath);
+    for (const auto& candidate : candidates) {
+      if ((mod.image = open(candidate, mod.buildId)))
+        return;
+    }
+    std::fprintf(stderr, "logvisor-symbolize: no symbols with build ID %s for %s\n", mod.buildId.c_str(),
+                 mod.path.c_str());
+  }
+
+public:
+  explicit Resolver(std::vector<std::string> dirs) : m_dirs(std::move(dirs)) {}
+
+  /* Parses "<index> 0x<base> <build ID or -> <path>" */
+  bool addModule(const char* fields) {
+    uint64_t index, base;
+    int pathStart = 0;
+    char buildId[2 * elf::MaxBuildIdSize + 1];
+    if (std::sscanf(fields, "%" SCNu64 " 0x%" SCNx64 " %64s %n", &index, &base, buildId, &pathStart) != 3 ||
+        !pathStart)
+      return false;
+    Module mod;
+    mod.base = base;
+    mod.buildId = buildId;
+    mod.path = fields + pathStart;
+    while (!mod.path.empty() && (mod.path.back() == '\n' || mod.path.back() == '\r'))
+      mod.path.pop_back();
+    const size_t slash = mod.path.rfind('/');
+    mod.name = slash != std::string::npos ? mod.path.substr(slash + 1) : mod.path;
+    m_modules[index] = std::move(mod);
+    return true;
+  }
+
+  /* Parses "<frame> 0x<address> <module index or ->" and prints it in the in-process symbolizer's format */
+  bool printFrame(const char* fields, FILE* out) {
+    uint64_t frame, addr;
+    char moduleField[24];
+    if (std::sscanf(fields, "%" SCNu64 " 0x%" SCNx64 " %23s", &frame, &addr, moduleField) != 3)
+      return false;
+    auto it = moduleField[0] != '-' ? m_modules.find(std::strtoull(moduleField, nullptr, 10)) : m_modules.end();
+    if (it == m_modules.end()) {
+      std::fprintf(out, "- 0x%" PRIx64 "\n", addr);
+      return true;
+    }
+    Module& mod = it->second;
+    if (!mod.searched)
+      locate(mod);
+    const uint64_t rel = addr - mod.base;
+    uint64_t symOffset = 0;
+    /* Return addresses point after the call, which may already be the next function */
+    const char* symName = mod.image ? mod.image->lookup(rel - 1, symOffset) : nullptr;
+    if (!symName) {
+      std::fprintf(out, "- ?? (%s+0x%" PRIx64 ")\n", mod.name.c_str(), rel);
+      return true;
+    }
+    int status;
+    char* demangledName = abi::__cxa_demangle(symName, nullptr, nullptr, &status);
+    std::fprintf(out, "- %s+0x%" PRIx64 " (%s+0x%" PRIx64 ")\n", demangledName ? demangledName : symName,
+                 symOffset + 1, mod.name.c_str(), rel);
+    std::free(demangledName);
+    return true;
+  }
+};
+
+int Symbolize(Resolver& resolver, FILE* in, FILE* out) {
+  std::string line;
+  char chunk[4096];
+  while (std::fgets(chunk, sizeof(chunk), in)) {
+    line += chunk;
+    if (line.back() != '\n' && !std::feof(in))
+      continue;
+    /* The lines may be embedded in a log with other prefixes */
+    if (const char* frame = std::strstr(line.c_str(), FrameTag)) {
+      std::fwrite(line.data(), 1, size_t(frame - line.c_str()), out);
+      if (!resolver.printFrame(frame + std::strlen(FrameTag), out))
+        std::fputs(frame, out);
+    } else {
+      if (const char* mod = std::strstr(line.c_str(), ModuleTag))
+        resolver.addModule(mod + std::strlen(ModuleTag));
+      std::fputs(line.c_str(), out);
+    }
+    line.clear();
+  }
+  return 0;
+}
+
+} // anonymous namespace
+
+int main(int argc, char** argv) {
+  std::vector<std::string> dirs;
+  bool badArgs = false;
+  const char* inPath = nullptr;
+  const char* outPath = nullptr;
+  for (int i = 1; i < argc; ++i) {
+    if (!std::strcmp(argv[i], "-d")) {
+      if (++i < argc)
+        dirs.emplace_back(argv[i]);
+      else
+        badArgs = true;
+    } else if (!inPath) {
+      inPath = argv[i];
+    } else if (!outPath) {
+      outPath = argv[i];
+    } else {
+      badArgs = true;
+    }
+  }
+  if (badArgs) {
+    std::fputs("Usage: logvisor-symbolize [-d <dir>]... [input] [output]\n", stderr);
+    return 2;
+  }
+
+  FILE* in = inPath ? std::fopen(inPath, "r") : stdin;
+  if (!in) {
+    std::fprintf(stderr, "logvisor-symbolize: unable to open %s\n", inPath);
+    return 1;
+  }
+  FILE* out = outPath ? std::fopen(outPath, "w") : stdout;
+  if (!out) {
+    std::fprintf(stderr, "logvisor-symbolize: unable to open %s\n", outPath);
+    if (in != stdin)
+      std::fclose(in);
+    return 1;
+  }
+
+  Resolver resolver(std::move(dirs));
+  const int ret = Symbolize(resolver, in, out);
+  if (in != stdin)
+    std::fclose(in);
+  if (out != stdout)
+    std::fclose(out);
+  return ret;
+}
+
+#else
+
+int main() {
+  std::fputs("logvisor-symbolize: ELF symbol tables are not supported on this platform\n", stderr);
+  return 1;
+}
+
+#endif